@@ -3,9 +3,21 @@
 #include <list>
 #include <boost/program_options.hpp>
 #include <fstream>
+#include <iomanip>                       // setprecision()
+#include <limits>                        // numeric_limits
+#include <cmath>                         // pow()
 #include <sstream>                       // istringstream
 #include <stdexcept>                     // std::runtime_error, std::invalid_argument
 #include <unordered_map>
+#include <memory>                        // std::shared_ptr, std::unique_ptr
+#include <mutex>                         // std::mutex, std::lock_guard
+#include <random>                        // std::random_device
+#include <exception>                     // std::exception_ptr
+#include <functional>                    // std::bind()
+#include <algorithm>                     // std::min(), std::max(), std::stable_sort()
+#include <numeric>                       // std::iota(), std::accumulate()
+#include <limits>                        // std::numeric_limits
+#include <csignal>                       // std::signal(), std::sig_atomic_t
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp> // fs::path
 
@@ -13,10 +25,14 @@
 #include <FileTools/include/FASTA_element.hpp>   // FASTA_element
 
 #include <Clustering/EMSequenceEngine.hpp>
+#include <Application/SequenceBatchReader.hpp>
 #include <Matrix/Matrix2D.hpp>
 #include <GUI/LogoWindow/LogoWindow.hpp>
 #include <GUI/ConsoleProgressBar/ConsoleProgressBar.hpp>
+#include <Parallel/ThreadPool.hpp>
+#include <Utility/PackedSequenceSet.hpp>
 #include <Utility/Constants.hpp>        // Constants::clustering_codes
+#include <Utility/DNA_utility.hpp>      // dna::base_composition()
 #include <Utility/String_utility.hpp>   // ends_with()
 
 #include "Application.hpp"
@@ -27,6 +43,18 @@
 std::string version("v1.0") ;
 // possible seeding mode options
 static std::string seeding_random("random") ;
+static std::string seeding_kmer("kmer") ;
+// possible stopping rule options
+static std::string stop_delta("delta") ;
+static std::string stop_loglik("loglik") ;
+static std::string stop_both("both") ;
+// possible acceleration options
+static std::string accelerate_none("none") ;
+static std::string accelerate_squarem("squarem") ;
+// whether a termination request (SIGTERM) was received
+static volatile std::sig_atomic_t termination_requested = 0 ;
+static void request_termination(int)
+{   termination_requested = 1 ; }
 
 
 namespace fs = boost::filesystem;
@@ -54,6 +82,14 @@ int Application::run() throw (std::invalid_argument, std::runtime_error)
     if(this->exit_code == EXIT_FAILURE)
     {   return EXIT_FAILURE ; }
 
+    // stream the data
+    if(this->options.batch_size)
+    {   if(this->options.use_float)
+        {   return this->classify_online<float>() ; }
+        else
+        {   return this->classify_online<double>() ; }
+    }
+
     // load data
     Matrix2D<char> sequences ;
     if(this->options.file_fasta)
@@ -64,62 +100,716 @@ int Application::run() throw (std::invalid_argument, std::runtime_error)
     else
     {   sequences = Matrix2D<char>(this->options.file_data) ; }
 
-    // set things ready
-    EMSequenceEngine* em = nullptr ;
+    // classify, storing the posterior probabilities using the requested precision
+    if(this->options.classes_to or this->options.length_to)
+    {   if(this->options.use_float)
+        {   return this->classify_sweep<float>(sequences) ; }
+        else
+        {   return this->classify_sweep<double>(sequences) ; }
+    }
+    else if(this->options.use_float)
+    {   return this->classify<float>(sequences) ; }
+    else
+    {   return this->classify<double>(sequences) ; }
+}
+
+template<class T>
+int Application::classify(const Matrix2D<char>& sequences) throw (std::invalid_argument, std::runtime_error)
+{
+    // the sequences are encoded once, all the runs share them
+    std::shared_ptr<const PackedSequenceSet> sequences_packed = std::make_shared<PackedSequenceSet>(sequences) ;
+
+    // the seed of each run, derived from the master seed
+    size_t n_run = this->options.restarts_n ;
+    std::string seed = this->options.seed ;
+    if(seed == "" and n_run > 1)
+    {   std::random_device rd ;
+        seed = std::to_string(rd()) ;
+        std::cout << "Master seed " << seed << std::endl ;
+    }
+    std::vector<std::string> seeds(n_run, seed) ;
+    for(size_t r=1; r<n_run; r++)
+    {   seeds[r] = seed + "_" + std::to_string(r) ; }
+
+    // the runs are dispatched over the threads, the remaining threads
+    // are used by each run
+    size_t n_worker     = std::min(n_run, this->options.threads_n) ;
+    size_t n_thread_run = std::max(static_cast<size_t>(1), this->options.threads_n / n_worker) ;
+
+    ConsoleProgressBar bar(std::cerr, this->options.iteration_n*n_run, 50, "classification") ;
+    std::mutex mutex ;
+
+    // the current state is saved before terminating
+    if(this->options.checkpoint.size())
+    {   std::signal(SIGTERM, request_termination) ; }
+
+    // only the best run so far is kept, the ties are broken using the
+    // run index such that the result does not depend on the order in
+    // which the runs end
+    std::unique_ptr<EMSequenceEngine<T>> em ;
+    size_t run_best  = 0 ;
+    size_t n_iter    = 0 ;
+    int    code      = Constants::clustering_codes::SUCCESS ;
+    // the log likelihood and the posterior change of each iteration
+    std::vector<double> log_likelihoods ;
+    std::vector<double> deltas ;
+    // errors are raised once all runs are over
+    std::vector<std::exception_ptr> errors(n_run) ;
+    auto run = [this, &sequences_packed, &seeds, n_thread_run, &bar, &mutex,
+                &em, &run_best, &n_iter, &code, &log_likelihoods, &deltas, &errors](size_t r)
+               {   try
+                   {   std::unique_ptr<EMSequenceEngine<T>> em_run(this->create_engine<T>(sequences_packed,
+                                                                                          seeds[r],
+                                                                                          n_thread_run)) ;
+                       // a resumed run goes on from the checkpoint iteration
+                       size_t n_iter_run = em_run->get_n_iter() ;
+                       {   std::lock_guard<std::mutex> lock(mutex) ;
+                           for(size_t i=0; i<n_iter_run; i++)
+                           {   bar.update() ; }
+                       }
+                       std::vector<double> log_likelihoods_run ;
+                       std::vector<double> deltas_run ;
+                       int code_run = this->optimize(*em_run, n_iter_run, log_likelihoods_run,
+                                                     deltas_run, bar, mutex) ;
+
+                       std::lock_guard<std::mutex> lock(mutex) ;
+                       double log_likelihood = em_run->get_log_likelihood() ;
+                       if((not em) or
+                          (log_likelihood > em->get_log_likelihood()) or
+                          (log_likelihood == em->get_log_likelihood() and r < run_best))
+                       {   em              = std::move(em_run) ;
+                           run_best        = r ;
+                           n_iter          = n_iter_run ;
+                           code            = code_run ;
+                           log_likelihoods = log_likelihoods_run ;
+                           deltas          = deltas_run ;
+                       }
+                   }
+                   catch(...)
+                   {   errors[r] = std::current_exception() ; }
+               } ;
+    // serial
+    if(n_worker == 1)
+    {   for(size_t r=0; r<n_run; r++)
+        {   run(r) ; }
+    }
+    // parallel
+    else
+    {   ThreadPool pool(n_worker) ;
+        for(size_t r=0; r<n_run; r++)
+        {   pool.addJob(std::bind(run, r)) ; }
+        pool.join() ;
+    }
+    for(const auto& error : errors)
+    {   if(error)
+        {   std::rethrow_exception(error) ; }
+    }
+
+    // make sure that the progress bar is filled
+    bar.fill() ;
+    bar.display() ;
+    std::cerr << std::endl ;
+
+    if(termination_requested)
+    {   std::cout << "Interrupted after " << n_iter << " iterations, checkpoint written to "
+                  << this->options.checkpoint << std::endl ;
+        this->exit_code = EXIT_FAILURE ;
+        return this->exit_code ;
+    }
+    if(n_run > 1)
+    {   std::cout << "Best run " << run_best+1 << " out of " << n_run
+                  << " (log likelihood " << em->get_log_likelihood() << ")" << std::endl ;
+    }
+    if(code == Constants::clustering_codes::CONVERGENCE)
+    {   std::cout << "Converged after " << n_iter-1 << " iterations" << std::endl ;
+        this->exit_code = EXIT_SUCCESS ;
+    }
+    else if(code == Constants::clustering_codes::SUCCESS)
+    {   std::cout << "Finished after " << this->options.iteration_n-1 << " iterations" << std::endl ;
+        this->exit_code = EXIT_SUCCESS ;
+    }
+
+    // write the results
+    if(this->options.prefix.size())
+    {   this->write_results(*em) ;
+        this->write_trace(log_likelihoods, deltas, em->get_n_iter()-log_likelihoods.size()) ;
+    }
+
+    // display logos with uniform background
+    if(not this->options.nogui)
+    {   std::vector<double> bg_prob(4,0.25) ;
+        std::vector<Matrix2D<double>> motifs = em->get_motifs() ;
+        this->displayMotifs(motifs, bg_prob) ;
+    }
+
+    return this->exit_code ;
+}
+
+template<class T>
+int Application::classify_sweep(const Matrix2D<char>& sequences) throw (std::invalid_argument, std::runtime_error)
+{
+    // the sequences are encoded once, all the models share them
+    std::shared_ptr<const PackedSequenceSet> sequences_packed = std::make_shared<PackedSequenceSet>(sequences) ;
+    // so are the background log probability prefix sums, which do not
+    // depend on the motif length
+    std::vector<double> bg_prob = dna::base_composition(*sequences_packed, this->options.flip) ;
+    std::shared_ptr<const Matrix3D<double>> bg_log_prefix =
+            std::make_shared<Matrix3D<double>>(dna::background_log_prefix(*sequences_packed,
+                                                                          bg_prob,
+                                                                          this->options.flip)) ;
+
+    // the number of classes and motif length of each model, by increasing
+    // number of classes for each length
+    size_t classes_from = this->options.classes_to ? this->options.classes_from : this->options.classes_n ;
+    size_t classes_to   = this->options.classes_to ? this->options.classes_to   : this->options.classes_n ;
+    size_t length_from  = this->options.length_to  ? this->options.length_from  : this->options.motif_l ;
+    size_t length_to    = this->options.length_to  ? this->options.length_to    : this->options.motif_l ;
+    std::vector<std::pair<size_t,size_t>> models ;
+    for(size_t l=length_from; l<=length_to; l++)
+    {   for(size_t k=classes_from; k<=classes_to; k++)
+        {   models.emplace_back(k, l) ; }
+    }
+    size_t n_model = models.size() ;
+
+    // the models are dispatched over the threads, unless each one is
+    // seeded from the previous one
+    size_t n_worker     = this->options.classes_split ? 1 : std::min(n_model, this->options.threads_n) ;
+    size_t n_thread_run = std::max(static_cast<size_t>(1), this->options.threads_n / n_worker) ;
+
+    ConsoleProgressBar bar(std::cerr, this->options.iteration_n*n_model, 50, "classification") ;
+    std::mutex mutex ;
+
+    // the random number generator used to split the motifs
+    std::mt19937 generator ;
+    if(this->options.seed != "")
+    {   std::seed_seq seed_sequence(this->options.seed.begin(), this->options.seed.end()) ;
+        generator.seed(seed_sequence) ;
+    }
+    else
+    {   std::random_device rd ;
+        generator.seed(rd()) ;
+    }
+
+    size_t n_flip = 1 + this->options.flip ;
+    double n_obs  = sequences.get_nrow() ;
+
+    // only the model with the lowest BIC is kept, the ties are broken
+    // using the model index
+    std::unique_ptr<EMSequenceEngine<T>> em ;
+    size_t model_best = 0 ;
+    double bic_best   = 0. ;
+    std::vector<double> log_likelihoods ;
+    std::vector<double> deltas ;
+    // classes, length, iterations, log likelihood, parameters, BIC and AIC of each model
+    std::vector<std::vector<double>> table(n_model) ;
+    // the starting motifs of each model, when splitting
+    std::vector<std::vector<Matrix2D<double>>> motifs_split(n_model) ;
+    // errors are raised once all models are over
+    std::vector<std::exception_ptr> errors(n_model) ;
+    auto run = [this, &sequences_packed, &bg_log_prefix, &models, n_thread_run, &bar, &mutex, &generator,
+                n_flip, n_obs, &em, &model_best, &bic_best, &log_likelihoods, &deltas, &table,
+                &motifs_split, &errors](size_t m)
+               {   try
+                   {   size_t n_class = models[m].first ;
+                       size_t l_motif = models[m].second ;
+                       std::unique_ptr<EMSequenceEngine<T>> em_run ;
+                       if(motifs_split[m].size())
+                       {   em_run.reset(new EMSequenceEngine<T>(sequences_packed,
+                                                                motifs_split[m],
+                                                                this->options.flip,
+                                                                this->options.center_shift,
+                                                                this->options.bg_class,
+                                                                n_thread_run)) ;
+                       }
+                       else
+                       {   em_run.reset(new EMSequenceEngine<T>(sequences_packed,
+                                                                n_class,
+                                                                l_motif,
+                                                                this->options.flip,
+                                                                this->options.center_shift,
+                                                                this->options.bg_class,
+                                                                this->options.seed,
+                                                                this->options.seeding,
+                                                                n_thread_run)) ;
+                       }
+                       this->configure_engine(*em_run) ;
+                       em_run->set_background_log_prefix(bg_log_prefix) ;
+                       size_t n_iter_run = 0 ;
+                       std::vector<double> log_likelihoods_run ;
+                       std::vector<double> deltas_run ;
+                       this->optimize(*em_run, n_iter_run, log_likelihoods_run, deltas_run, bar, mutex) ;
+                       if(this->options.classes_split and m+1 < motifs_split.size())
+                       {   motifs_split[m+1] = this->split_motifs(*em_run, generator) ; }
+
+                       // the full sequences are scored such that the lengths can be compared,
+                       // the number of free parameters is 3 per motif position of each trained
+                       // class and the class probabilities, summing to 1
+                       double log_likelihood = em_run->compute_sequence_log_likelihood() ;
+                       size_t n_shift = sequences_packed->get_lseq() - l_motif + 1 ;
+                       double n_param = 3.*n_class*l_motif +
+                                        (n_class + this->options.bg_class)*n_shift*n_flip - 1. ;
+                       double bic = -2.*log_likelihood + n_param*std::log(n_obs) ;
+                       double aic = -2.*log_likelihood + 2.*n_param ;
+
+                       std::lock_guard<std::mutex> lock(mutex) ;
+                       table[m] = {static_cast<double>(n_class), static_cast<double>(l_motif),
+                                   static_cast<double>(n_iter_run), log_likelihood, n_param, bic, aic} ;
+                       if((not em) or (bic < bic_best) or (bic == bic_best and m < model_best))
+                       {   em              = std::move(em_run) ;
+                           model_best      = m ;
+                           bic_best        = bic ;
+                           log_likelihoods = log_likelihoods_run ;
+                           deltas          = deltas_run ;
+                       }
+                   }
+                   catch(...)
+                   {   errors[m] = std::current_exception() ; }
+               } ;
+    // serial, stops at the first error since a split model needs the previous one
+    if(n_worker == 1)
+    {   for(size_t m=0; m<n_model and not (m and errors[m-1]); m++)
+        {   run(m) ; }
+    }
+    // parallel
+    else
+    {   ThreadPool pool(n_worker) ;
+        for(size_t m=0; m<n_model; m++)
+        {   pool.addJob(std::bind(run, m)) ; }
+        pool.join() ;
+    }
+    for(const auto& error : errors)
+    {   if(error)
+        {   std::rethrow_exception(error) ; }
+    }
+
+    // make sure that the progress bar is filled
+    bar.fill() ;
+    bar.display() ;
+    std::cerr << std::endl ;
+
+    std::cout << "classes\tlength\titerations\tlog likelihood\tparameters\tBIC\tAIC" << std::endl ;
+    for(const auto& row : table)
+    {   for(size_t i=0; i<row.size(); i++)
+        {   std::cout << row[i] << (i+1 < row.size() ? '\t' : '\n') ; }
+    }
+    std::cout << "Best model " << table[model_best][0] << " classes of length " << table[model_best][1]
+              << " (BIC " << bic_best << ")" << std::endl ;
+    this->exit_code = EXIT_SUCCESS ;
+
+    // write the results of the best model
+    if(this->options.prefix.size())
+    {   this->write_results(*em) ;
+        this->write_trace(log_likelihoods, deltas) ;
+        this->write_model_selection(table) ;
+    }
+
+    // display logos with uniform background
+    if(not this->options.nogui)
+    {   std::vector<double> bg_prob(4,0.25) ;
+        std::vector<Matrix2D<double>> motifs = em->get_motifs() ;
+        this->displayMotifs(motifs, bg_prob) ;
+    }
+
+    return this->exit_code ;
+}
+
+template<class T>
+std::vector<Matrix2D<double>> Application::split_motifs(const EMSequenceEngine<T>& em,
+                                                        std::mt19937& generator) const
+{   // the trained classes only, the background class is the last one
+    std::vector<Matrix2D<double>> motifs = em.get_motifs() ;
+    std::vector<double> class_prob = em.get_class_prob_total() ;
+    if(this->options.bg_class)
+    {   motifs.pop_back() ; }
+
+    size_t k_max = 0 ;
+    for(size_t k=1; k<motifs.size(); k++)
+    {   if(class_prob[k] > class_prob[k_max])
+        {   k_max = k ; }
+    }
+
+    Matrix2D<double> motif_1 = motifs[k_max] ;
+    Matrix2D<double> motif_2 = motifs[k_max] ;
+    std::uniform_real_distribution<double> noise(-Constants::split_noise, Constants::split_noise) ;
+    for(size_t j=0; j<motif_1.get_ncol(); j++)
+    {   double sum_1 = 0., sum_2 = 0. ;
+        for(size_t i=0; i<motif_1.get_nrow(); i++)
+        {   double u = noise(generator) ;
+            motif_1(i,j) *= 1. + u ;
+            motif_2(i,j) *= 1. - u ;
+            sum_1 += motif_1(i,j) ;
+            sum_2 += motif_2(i,j) ;
+        }
+        for(size_t i=0; i<motif_1.get_nrow(); i++)
+        {   motif_1(i,j) /= sum_1 ;
+            motif_2(i,j) /= sum_2 ;
+        }
+    }
+    motifs[k_max] = motif_1 ;
+    motifs.insert(motifs.begin() + k_max + 1, motif_2) ;
+    return motifs ;
+}
+
+std::vector<Matrix2D<double>> Application::select_library_motifs(const PackedSequenceSet& sequences,
+                                                                 size_t n_threads) const throw (std::runtime_error)
+{   // the library files, sorted by name such that the ranking of ties is reproducible
+    fs::path library(this->options.seeding_library) ;
+    if(not fs::is_directory(library))
+    {   throw std::runtime_error("error! " + this->options.seeding_library + " is not a directory!") ; }
+    std::vector<std::string> files ;
+    for(fs::directory_iterator file(library); file!=fs::directory_iterator(); file++)
+    {   if(fs::is_regular_file(file->status()))
+        {   files.push_back(file->path().string()) ; }
+    }
+    std::sort(files.begin(), files.end()) ;
+    if(files.size() < this->options.classes_n)
+    {   throw std::runtime_error("error! " + this->options.seeding_library + " contains fewer motifs than classes!") ; }
+
+    // load the motifs and fit them to the motif length
+    std::vector<double> bg_prob = dna::base_composition(sequences, this->options.flip) ;
+    size_t l_motif = this->options.motif_l ;
+    std::vector<Matrix2D<double>> motifs(files.size(), Matrix2D<double>(4, l_motif)) ;
+    for(size_t m=0; m<files.size(); m++)
+    {   Matrix2D<double> motif(files[m]) ;
+        if(motif.get_nrow() != 4 or motif.get_ncol() == 0)
+        {   throw std::runtime_error("error! " + files[m] + " does not contain a motif (4 rows expected)!") ; }
+        // probabilities (the files may contain counts), mixed with the background
+        // such that a base never seen in a library motif is not excluded
+        size_t n_col = motif.get_ncol() ;
+        for(size_t j=0; j<n_col; j++)
+        {   double sum = 0. ;
+            for(size_t i=0; i<4; i++)
+            {   motif(i,j) = std::max(motif(i,j), Constants::pseudo_counts) ;
+                sum += motif(i,j) ;
+            }
+            for(size_t i=0; i<4; i++)
+            {   motif(i,j) = (1.-Constants::library_bg_weight)*motif(i,j)/sum +
+                             Constants::library_bg_weight*bg_prob[i] ;
+            }
+        }
+        // the most informative window of a motif too long
+        size_t from = 0 ;
+        if(n_col > l_motif)
+        {   std::vector<double> information(n_col, 0.) ;
+            for(size_t j=0; j<n_col; j++)
+            {   for(size_t i=0; i<4; i++)
+                {   information[j] += motif(i,j) * std::log(motif(i,j) / bg_prob[i]) ; }
+            }
+            double information_max = -std::numeric_limits<double>::max() ;
+            for(size_t start=0; start+l_motif<=n_col; start++)
+            {   double information_window = std::accumulate(information.begin() + start,
+                                                             information.begin() + start + l_motif, 0.) ;
+                if(information_window > information_max)
+                {   information_max = information_window ;
+                    from = start ;
+                }
+            }
+        }
+        // a motif too short is centered, the remaining columns are the background
+        size_t offset = n_col < l_motif ? (l_motif - n_col) / 2 : 0 ;
+        for(size_t j=0; j<l_motif; j++)
+        {   for(size_t i=0; i<4; i++)
+            {   motifs[m](i,j) = (j >= offset and j < offset + n_col) ? motif(i,from+j-offset) : bg_prob[i] ; }
+        }
+    }
+
+    // sequences drawn from the background, the best site score expected by
+    // chance increases with the motif information content
+    std::mt19937 generator ;
+    std::seed_seq seed_sequence(this->options.seed.begin(), this->options.seed.end()) ;
+    generator.seed(seed_sequence) ;
+    std::discrete_distribution<size_t> base(bg_prob.begin(), bg_prob.end()) ;
+    Matrix2D<char> background_char(sequences.get_nseq(), sequences.get_lseq()) ;
+    for(size_t i=0; i<background_char.get_nrow(); i++)
+    {   for(size_t j=0; j<background_char.get_ncol(); j++)
+        {   background_char(i,j) = "ACGT"[base(generator)] ; }
+    }
+    PackedSequenceSet background(background_char) ;
+
+    // score the motifs, one batch per thread
+    size_t n_batch    = std::max(static_cast<size_t>(1), std::min(n_threads, motifs.size())) ;
+    size_t batch_size = (motifs.size() + n_batch - 1) / n_batch ;
+    std::vector<double> scores(motifs.size()) ;
+    auto score_batch = [this, &sequences, &background, &motifs, &bg_prob, &scores, batch_size](size_t batch)
+                       {   size_t from = std::min(batch*batch_size, motifs.size()) ;
+                           size_t to   = std::min(from+batch_size, motifs.size()) ;
+                           std::vector<Matrix2D<double>> motifs_batch(motifs.begin() + from, motifs.begin() + to) ;
+                           std::vector<double> scores_data = dna::best_site_log_odds(sequences, motifs_batch,
+                                                                                     bg_prob, this->options.flip) ;
+                           std::vector<double> scores_bg   = dna::best_site_log_odds(background, motifs_batch,
+                                                                                     bg_prob, this->options.flip) ;
+                           for(size_t m=from; m<to; m++)
+                           {   scores[m] = scores_data[m-from] - scores_bg[m-from] ; }
+                       } ;
+    // serial
+    if(n_batch == 1)
+    {   score_batch(0) ; }
+    // parallel
+    else
+    {   ThreadPool pool(n_batch) ;
+        for(size_t batch=0; batch<n_batch; batch++)
+        {   pool.addJob(std::bind(score_batch, batch)) ; }
+        pool.join() ;
+    }
+
+    // keep the best motifs
+    std::vector<size_t> ranking(motifs.size()) ;
+    std::iota(ranking.begin(), ranking.end(), 0) ;
+    std::stable_sort(ranking.begin(), ranking.end(),
+                     [&scores](size_t a, size_t b) { return scores[a] > scores[b] ; }) ;
+    std::vector<Matrix2D<double>> motifs_best ;
+    for(size_t r=0; r<this->options.classes_n; r++)
+    {   motifs_best.push_back(motifs[ranking[r]]) ;
+        std::cout << "Library motif " << files[ranking[r]] << " (best site log-odds enrichment "
+                  << scores[ranking[r]] << ")" << std::endl ;
+    }
+    return motifs_best ;
+}
+
+template<class T>
+EMSequenceEngine<T>* Application::create_engine(std::shared_ptr<const PackedSequenceSet> sequences,
+                                                const std::string& seed,
+                                                size_t n_threads,
+                                                bool warm_start) const throw (std::invalid_argument, std::runtime_error)
+{   EMSequenceEngine<T>* em = nullptr ;
+    // the settings are restored with the model
+    if(this->options.resume.size())
+    {   em = new EMSequenceEngine<T>(sequences, this->options.resume, n_threads) ;
+        return em ;
+    }
+    // motifs are trained on a subsample first, the full data are only used to refine them
+    else if(warm_start and this->options.warmstart_fraction < 1.)
+    {   Matrix3D<double> class_prob ;
+        em = new EMSequenceEngine<T>(sequences,
+                                     this->train_on_subsample<T>(sequences, seed, n_threads, class_prob),
+                                     this->options.flip,
+                                     this->options.center_shift,
+                                     this->options.bg_class,
+                                     n_threads) ;
+        em->set_class_prob(class_prob) ;
+    }
+    // motifs are selected from a library
+    else if(this->options.seeding_library.size())
+    {   em = new EMSequenceEngine<T>(sequences,
+                                     this->select_library_motifs(*sequences, n_threads),
+                                     this->options.flip,
+                                     this->options.center_shift,
+                                     this->options.bg_class,
+                                     n_threads) ;
+    }
     // motif are provided within files
-    if(this->options.seeding.find(",") != std::string::npos)
+    else if(this->options.seeding.find(",") != std::string::npos)
     {   std::vector<Matrix2D<double>> priors ;
         for(auto& file : split(this->options.seeding, ','))
         {   priors.push_back(Matrix2D<double>(file)) ; }
 
-        em = new EMSequenceEngine(sequences,
-                                  priors,
-                                  this->options.flip,
-                                  this->options.center_shift,
-                                  this->options.bg_class) ;
+        em = new EMSequenceEngine<T>(sequences,
+                                     priors,
+                                     this->options.flip,
+                                     this->options.center_shift,
+                                     this->options.bg_class,
+                                     n_threads) ;
     }
     // de-novo discovery
     else
-    {   em = new EMSequenceEngine(sequences,
-                                  this->options.classes_n,
-                                  this->options.motif_l,
-                                  this->options.flip,
-                                  this->options.center_shift,
-                                  this->options.bg_class,
-                                  this->options.seed,
-                                  this->options.seeding) ;
+    {   em = new EMSequenceEngine<T>(sequences,
+                                     this->options.classes_n,
+                                     this->options.motif_l,
+                                     this->options.flip,
+                                     this->options.center_shift,
+                                     this->options.bg_class,
+                                     seed,
+                                     this->options.seeding,
+                                     n_threads) ;
     }
+    this->configure_engine(*em) ;
+    return em ;
+}
 
-    ConsoleProgressBar bar(std::cerr, this->options.iteration_n, 50, "classification") ;
+template<class T>
+std::vector<Matrix2D<double>> Application::train_on_subsample(std::shared_ptr<const PackedSequenceSet> sequences,
+                                                              const std::string& seed,
+                                                              size_t n_threads,
+                                                              Matrix3D<double>& class_prob) const throw (std::invalid_argument, std::runtime_error)
+{   std::mt19937 generator ;
+    if(seed != "")
+    {   std::seed_seq seed_sequence(seed.begin(), seed.end()) ;
+        generator.seed(seed_sequence) ;
+    }
+    else
+    {   std::random_device rd ;
+        generator.seed(rd()) ;
+    }
 
-    // classify
-    size_t n_iter_cur = 0 ;
+    // the subsample, the sequences keep their original order
+    size_t n_seq    = sequences->get_nseq() ;
+    size_t n_sample = static_cast<size_t>(std::ceil(this->options.warmstart_fraction * n_seq)) ;
+    n_sample        = std::min(n_seq, std::max(n_sample, this->options.classes_n)) ;
+    std::vector<size_t> indices(n_seq) ;
+    std::iota(indices.begin(), indices.end(), 0) ;
+    std::shuffle(indices.begin(), indices.end(), generator) ;
+    indices.resize(n_sample) ;
+    std::sort(indices.begin(), indices.end()) ;
+    std::shared_ptr<const PackedSequenceSet> subsample = std::make_shared<PackedSequenceSet>(*sequences, indices) ;
+
+    // train the motifs
+    std::unique_ptr<EMSequenceEngine<T>> em(this->create_engine<T>(subsample, seed, n_threads, false)) ;
+    size_t n_iter = 0 ;
     int code ;
     do
     {   code = em->cluster() ;
+        n_iter++ ;
+    }
+    while(n_iter < this->options.iteration_n and
+          code != Constants::clustering_codes::CONVERGENCE and
+          not termination_requested) ;
+
+    // the trained classes only, the background class is the last one
+    std::vector<Matrix2D<double>> motifs = em->get_motifs() ;
+    if(this->options.bg_class)
+    {   motifs.pop_back() ; }
+    class_prob = em->get_class_prob() ;
+    return motifs ;
+}
+
+template<class T>
+void Application::configure_engine(EMSequenceEngine<T>& em) const throw (std::invalid_argument)
+{   em.set_fused(this->options.fused) ;
+    em.set_sparse(this->options.sparse_threshold) ;
+    em.set_shift_band(this->options.shift_window, this->options.shift_threshold) ;
+    em.set_incremental(this->options.incremental_threshold) ;
+    em.set_hard(this->options.hard) ;
+    em.set_stopping_rule(this->options.stopping_rule, this->options.tolerance) ;
+    em.set_acceleration(this->options.acceleration) ;
+}
+
+template<class T>
+int Application::optimize(EMSequenceEngine<T>& em,
+                          size_t& n_iter,
+                          std::vector<double>& log_likelihoods,
+                          std::vector<double>& deltas,
+                          ConsoleProgressBar& bar,
+                          std::mutex& bar_mutex) const
+{   int code ;
+    bool terminate = false ;
+    do
+    {   code = em.cluster() ;
+        n_iter++ ;
+        log_likelihoods.push_back(em.get_log_likelihood()) ;
+        deltas.push_back(em.get_post_prob_delta()) ;
+        // checkpoint
+        terminate = termination_requested ;
+        if(this->options.checkpoint.size() and
+           (terminate or
+            (this->options.checkpoint_every and n_iter % this->options.checkpoint_every == 0)))
+        {   em.write_checkpoint(this->options.checkpoint) ; }
+        std::lock_guard<std::mutex> lock(bar_mutex) ;
+        bar.update() ;
+        bar.display() ;
+    }
+    while(n_iter < this->options.iteration_n and
+          code != Constants::clustering_codes::CONVERGENCE and
+          not terminate) ;
+    return code ;
+}
+
+template<class T>
+int Application::classify_online() throw (std::invalid_argument, std::runtime_error)
+{   // from and to are only used with fasta files
+    int from = this->options.file_fasta ? this->options.from : -1 ;
+    int to   = this->options.file_fasta ? this->options.to   : -1 ;
+    SequenceBatchReader reader(this->options.file_data,
+                               this->options.file_fasta,
+                               this->options.batch_size,
+                               from, to) ;
+
+    // the background probabilities, over all the sequences
+    Matrix2D<char> batch ;
+    std::vector<double> bg_prob(4, 0.) ;
+    while(reader.get_next(batch))
+    {   std::vector<double> batch_prob = dna::base_composition(batch, this->options.flip) ;
+        for(size_t i=0; i<4; i++)
+        {   bg_prob[i] += batch_prob[i] * batch.get_nrow() ; }
+    }
+    size_t n_seq = reader.get_nseq_read() ;
+    if(n_seq == 0)
+    {   throw std::runtime_error("error! no sequence found in the data file!") ; }
+    for(auto& p : bg_prob)
+    {   p /= n_seq ; }
+
+    // set things ready, the model is initialised on the first batches,
+    // holding at least one sequence per class
+    reader.rewind() ;
+    std::vector<Matrix2D<char>> batches_seed ;
+    size_t n_seq_seed = 0 ;
+    while(n_seq_seed < this->options.classes_n and reader.get_next(batch))
+    {   n_seq_seed += batch.get_nrow() ;
+        batches_seed.push_back(batch) ;
+    }
+    Matrix2D<char> sequences_seed(n_seq_seed, batches_seed.front().get_ncol()) ;
+    for(size_t b=0, i_seed=0; b<batches_seed.size(); b++)
+    {   for(size_t i=0; i<batches_seed[b].get_nrow(); i++, i_seed++)
+        {   for(size_t j=0; j<batches_seed[b].get_ncol(); j++)
+            {   sequences_seed(i_seed,j) = batches_seed[b](i,j) ; }
+        }
+    }
+    batches_seed.clear() ;
+    std::unique_ptr<EMSequenceEngine<T>> em(this->create_engine<T>(std::make_shared<PackedSequenceSet>(sequences_seed),
+                                                                   this->options.seed,
+                                                                   this->options.threads_n)) ;
+    em->set_background_prob(bg_prob) ;
+
+    ConsoleProgressBar bar(std::cerr, this->options.iteration_n, 50, "classification") ;
+
+    // classify, one pass over the sequences per iteration
+    size_t n_iter_cur = 0 ;
+    size_t n_batch    = 0 ;
+    bool converged    = false ;
+    // the log likelihood of each pass, the posterior probabilities are not
+    // kept from one pass to the next and their change is not tracked
+    std::vector<double> log_likelihoods ;
+    std::vector<double> deltas ;
+    do
+    {   double log_likelihood = 0. ;
+        reader.rewind() ;
+        while(reader.get_next(batch))
+        {   em->set_sequences(batch) ;
+            em->cluster_batch(std::pow(n_batch+1., -this->options.step_decay)) ;
+            log_likelihood += em->get_log_likelihood() ;
+            n_batch++ ;
+        }
         n_iter_cur++ ;
+        if(n_iter_cur > 1)
+        {   double log_likelihood_prev = log_likelihoods.back() ;
+            converged = std::abs(log_likelihood - log_likelihood_prev) <=
+                        this->options.tolerance * std::abs(log_likelihood_prev) ;
+        }
+        log_likelihoods.push_back(log_likelihood) ;
+        deltas.push_back(std::numeric_limits<double>::quiet_NaN()) ;
         bar.update() ;
         bar.display() ;
     }
-    while(n_iter_cur < this->options.iteration_n and code != Constants::clustering_codes::CONVERGENCE) ;
+    while(n_iter_cur < this->options.iteration_n and not converged) ;
 
     // make sure that the progress bar is filled
     bar.fill() ;
     bar.display() ;
     std::cerr << std::endl ;
 
-    if(code == Constants::clustering_codes::CONVERGENCE)
-    {   std::cout << "Converged after " << n_iter_cur-1 << " iterations" << std::endl ;
-        this->exit_code = EXIT_SUCCESS ;
-    }
-    else if(code == Constants::clustering_codes::SUCCESS)
-    {   std::cout << "Finished after " << this->options.iteration_n-1 << " iterations" << std::endl ;
-        this->exit_code = EXIT_SUCCESS ;
-    }
+    if(converged)
+    {   std::cout << "Converged after " << n_iter_cur-1 << " iterations" << std::endl ; }
+    else
+    {   std::cout << "Finished after " << this->options.iteration_n-1 << " iterations" << std::endl ; }
+    this->exit_code = EXIT_SUCCESS ;
 
-    // write the results
+    // write the results, the posterior probabilities in an extra pass
     if(this->options.prefix.size())
-    {   this->write_results(*em) ; }
+    {   this->write_motifs(*em) ;
+        this->write_class_prob(*em) ;
+        this->write_class_prob_total(*em) ;
+        this->write_post_prob_online(*em, reader) ;
+        this->write_trace(log_likelihoods, deltas) ;
+    }
 
     // display logos with uniform background
     if(not this->options.nogui)
@@ -128,10 +818,6 @@ int Application::run() throw (std::invalid_argument, std::runtime_error)
         this->displayMotifs(motifs, bg_prob) ;
     }
 
-    if(em != nullptr)
-    {   delete em ; }
-    em = nullptr ;
-
     return this->exit_code ;
 }
 
@@ -146,6 +832,13 @@ void Application::set_options(int argn, char** argv) throw (std::runtime_error)
 
     this->options.iteration_n  = 1 ;
     this->options.classes_n    = 1 ;
+    this->options.classes_from = 0 ;
+    this->options.classes_to   = 0 ;
+    this->options.classes_split = false ;
+    std::string classes_range  = "" ;
+    this->options.length_from  = 0 ;
+    this->options.length_to    = 0 ;
+    std::string length_range   = "" ;
     this->options.motif_l      = 1 ;
     this->options.flip         = false ;
     this->options.center_shift = false ;
@@ -153,7 +846,27 @@ void Application::set_options(int argn, char** argv) throw (std::runtime_error)
     this->options.bg_class     = false ;
     this->options.seed         = "" ;
     this->options.seeding      = seeding_random.c_str() ;
+    this->options.seeding_library = "" ;
     this->options.nogui        = false ;
+    this->options.threads_n    = 1 ;
+    this->options.fused        = false ;
+    this->options.use_float    = false ;
+    this->options.sparse_threshold = 0. ;
+    this->options.shift_window     = std::numeric_limits<size_t>::max() ;
+    this->options.shift_threshold  = 0. ;
+    this->options.incremental_threshold = 0. ;
+    this->options.hard             = false ;
+    this->options.stopping_rule = Constants::stopping_rules::POST_PROB_DELTA ;
+    this->options.tolerance     = 1e-6 ;
+    std::string stopping_rule   = stop_delta ;
+    this->options.acceleration  = accelerate_none ;
+    this->options.batch_size    = 0 ;
+    this->options.restarts_n    = 1 ;
+    this->options.warmstart_fraction = 1. ;
+    this->options.step_decay    = 0.7 ;
+    this->options.checkpoint    = "" ;
+    this->options.checkpoint_every = 10 ;
+    this->options.resume        = "" ;
 
     if(argv == nullptr)
     {   this->exit_code = -1 ;
@@ -188,27 +901,151 @@ void Application::set_options(int argn, char** argv) throw (std::runtime_error)
 
     std::string opt_iter_msg       = "The maximum number of iterations." ;
     std::string opt_classes_msg    = "The number of classes to use." ;
+    std::string opt_classes_range_msg = "Runs one classification for each number of classes in this range, "
+                                        "given as <from>:<to>, instead of --classes. The sequences are loaded "
+                                        "once and the classifications are run concurrently if several threads "
+                                        "are given. The full sequence log likelihood, BIC and AIC of each "
+                                        "number of classes are reported and the results of the lowest BIC are "
+                                        "written. Requires a seeding method other than motif files, cannot be "
+                                        "used with --restarts, --batch, --checkpoint nor --resume." ;
+    std::string opt_classes_split_msg = "With --classes-range, runs the classifications one after the other, "
+                                        "seeding each one with the motifs of the previous one, the most "
+                                        "probable motif being split into two perturbed copies. Cannot be "
+                                        "used with --length-range." ;
     std::string opt_length_msg     = "The motif length in base pair. All the motifs trained will be this long." ;
+    std::string opt_length_range_msg = "Runs one classification for each motif length in this range, given "
+                                       "as <from>:<to>, instead of --length, as --classes-range does (both "
+                                       "can be combined). The log likelihoods of the full sequences, the "
+                                       "bases outside of the motifs being scored by the background model, "
+                                       "are reported such that the lengths can be compared." ;
     std::string opt_flip_msg       = "Searches the reverse complement of the sequences.";
     std::string opt_shift_center   = "The shift probabilities will be renormalized at each iteration to make "
                                      "the density fit a gaussian centered on the most central shift state." ;
     std::string opt_bg_class_msg   = "Whether an extra class should be added to model the background.";
     std::string opt_write_msg      = "A path which will be used as prefix to write the results.";
     std::string opt_nogui_msg      = "Disable the GUI at the end to display the motifs.";
+    std::string opt_threads_msg    = "The number of threads to use to compute the sequence "
+                                     "probabilities, by default 1.";
+    std::string opt_fused_msg      = "Runs the E-step and the M-step in a single pass over the "
+                                     "sequences, without storing the sequence likelihoods. This "
+                                     "reduces the memory usage and the memory traffic. Cannot be "
+                                     "used with --batch." ;
+    std::string opt_float_msg      = "Stores the sequence likelihoods and posterior probabilities "
+                                     "using single precision floats instead of doubles. This halves "
+                                     "the memory usage." ;
+    char sparse_msg[1024] ;
+    sprintf(sparse_msg,
+            "Prunes, for each sequence, the least likely class, shift and flip states holding "
+            "at most this fraction of the posterior probability mass, such that they are "
+            "neither scored nor stored. All the states are scored every %zu E-steps to select "
+            "the states to keep, the convergence being only checked then. Cannot be used with "
+            "--fused nor --batch. By default 0, all the states are kept.",
+            Constants::sparse_period) ;
+    std::string opt_sparse_msg     = sparse_msg ;
+    std::string opt_shift_window_msg    = "Only scores the shifts within this number of shifts on each side of "
+                                          "the central shift. The likelihoods and posterior probabilities are "
+                                          "only stored for these shifts. By default, all the shifts are scored." ;
+    std::string opt_shift_threshold_msg = "Before each iteration, only scores the smallest range of shifts "
+                                          "containing all the shifts with a prior probability (summed over the "
+                                          "classes and strands) of at least this value. This is meant to be used "
+                                          "together with --flip, which also keeps the shift "
+                                          "probabilities gaussian. By default 0, all the shifts are scored." ;
+    char incremental_msg[1024] ;
+    sprintf(incremental_msg,
+            "Runs an incremental EM : the sequences which posterior probabilities changed by "
+            "at most this value during an iteration are frozen, they are not scored anymore and "
+            "their cached contributions are used to update the model. All the sequences are "
+            "scored again at least every %zu iterations, the convergence being only checked "
+            "then. Cannot be used with --sparse nor --batch. By default 0, all the sequences "
+            "are scored at each iteration.",
+            Constants::incremental_period) ;
+    std::string opt_incremental_msg = incremental_msg ;
+    std::string opt_hard_msg       = "Runs a classification EM : each sequence is assigned to its most likely "
+                                     "class, shift and strand only and the motifs are computed from the bases "
+                                     "of the assigned sub-sequences. The procedure converges once no "
+                                     "assignment changes. Cannot be used with --fused, --sparse, "
+                                     "--incremental nor --batch." ;
+    char stop_msg[1024] ;
+    sprintf(stop_msg,
+            "The rule used to decide whether the classification converged, among "
+            "'%s' (no posterior probability changed by more than 1e-6 during the last "
+            "iteration), '%s' (the relative change of the data log likelihood is at most "
+            "--tolerance) and '%s' (both). Cannot be used with --batch, which always "
+            "checks the log likelihood of a pass. By default, '%s' is used.",
+            stop_delta.c_str(), stop_loglik.c_str(), stop_both.c_str(), stop_delta.c_str()) ;
+    std::string opt_stop_msg       = stop_msg ;
+    std::string opt_tolerance_msg  = "The relative log likelihood tolerance used by the log likelihood "
+                                     "stopping rule, by default 1e-6." ;
+    char accelerate_msg[1024] ;
+    sprintf(accelerate_msg,
+            "The method used to accelerate the convergence, among '%s' and '%s'. With '%s', "
+            "each iteration runs two EM steps, extrapolates the parameters along their path "
+            "and runs a third EM step from the extrapolated parameters (a fourth one if the "
+            "extrapolation is rejected because it lowered the log likelihood). By default, "
+            "'%s' is used.",
+            accelerate_none.c_str(), accelerate_squarem.c_str(), accelerate_squarem.c_str(),
+            accelerate_none.c_str()) ;
+    std::string opt_accelerate_msg = accelerate_msg ;
+    std::string opt_batch_msg      = "Runs a stepwise (online) EM, streaming the sequences from the data file "
+                                     "in mini-batches of this number of sequences, such that the data set "
+                                     "does not have to fit in memory. Each iteration is then a pass over the "
+                                     "data and the convergence is checked on the log likelihood of a pass "
+                                     "(see --tolerance). The model is seeded on the first batches holding "
+                                     "at least --classes sequences. Cannot be used with --accelerate, "
+                                     "--fused nor --stop. "
+                                     "By default 0, all the sequences are loaded at once." ;
+    std::string opt_checkpoint_msg = "The address of a binary checkpoint file in which the model and the "
+                                     "settings are saved during the classification (see --checkpoint-every) "
+                                     "and upon termination request (SIGTERM), in which case the classification "
+                                     "stops after the current iteration. Cannot be used with --restarts nor "
+                                     "--batch." ;
+    std::string opt_checkpoint_every_msg = "The number of iterations between two checkpoints, by default 10. "
+                                           "With 0, a checkpoint is only written upon termination request." ;
+    std::string opt_resume_msg     = "Resumes the classification saved in this checkpoint file, without "
+                                     "seeding. The same data should be given. The number of classes, the "
+                                     "motif length and the options of the classification procedure are "
+                                     "those saved in the checkpoint, --iter includes the iterations run "
+                                     "before the checkpoint. Cannot be used with --restarts nor --batch." ;
+    std::string opt_step_decay_msg = "The stepwise EM step size decay : the batch of index t (over all passes, "
+                                     "starting at 0) is given a weight (t+1)^-decay. It should be in (0.5,1], "
+                                     "by default 0.7." ;
 
     char seeding_msg[2048] ;
     sprintf(seeding_msg,
             "Specifies which method should be used to initialise the program. "
             "Two different way of doing are possible. First, it is possible to "
-            "use a predefined seeding method using any word among '%s'. Second "
+            "use a predefined seeding method using any word among '%s', '%s'. Second "
             "it is possible to provide motif to optimize as starting points, using "
             "a list of coma-separated file addresses (if one file is provided only, "
             "it has to end with a coma). "
             "By default, '%s' is used, which initialises the posterior probabilities "
-            "at random from a beta distribution.",
-            seeding_random.c_str(), seeding_random.c_str()) ;
+            "at random from a beta distribution. '%s' seeds the motifs with the most "
+            "over-represented, mutually dissimilar, k-mers of the sequences (k being "
+            "the motif length, at most 8).",
+            seeding_random.c_str(), seeding_kmer.c_str(), seeding_random.c_str(), seeding_kmer.c_str()) ;
     std::string opt_seeding_msg = seeding_msg ;
+    std::string opt_seeding_library_msg = "Seeds the classes with the motifs of this directory (one motif "
+                                          "per file, in the same format as the motif files given to "
+                                          "--seeding) which best match the sequences. Each motif is fitted "
+                                          "to --length, trimmed to its most informative window or padded "
+                                          "with the background, and the --classes motifs with the highest "
+                                          "best site enrichment (the average log-odds score of the best site "
+                                          "of each sequence minus this average over as many sequences drawn "
+                                          "from the background) are kept. Cannot be used with --seeding, "
+                                          "--restarts, --batch, --resume, --classes-range nor --length-range." ;
     std::string opt_seed_msg       = "A value to seed the random number generator.";
+    std::string opt_restarts_msg   = "The number of classifications to run from different random starting "
+                                     "points, concurrently if several threads are given (see --threads). The "
+                                     "run reaching the highest log likelihood is kept and written. The first "
+                                     "run is seeded with --seed, the ith one with --seed followed by '_i'. "
+                                     "By default 1." ;
+    std::string opt_warmstart_msg  = "Trains the motifs on a random subsample containing this fraction of "
+                                     "the sequences first, until convergence, then refines them on all the "
+                                     "sequences, starting from the trained motifs and class probabilities. "
+                                     "The subsample is drawn using --seed and is seeded "
+                                     "according to --seeding. Cannot be used with --batch, --resume, "
+                                     "--classes-range nor --length-range. By default 1, the motifs are "
+                                     "trained on all the sequences from the start." ;
 
     desc.add_options()
             ("help,h",       opt_help_msg.c_str())
@@ -221,7 +1058,10 @@ void Application::set_options(int argn, char** argv) throw (std::runtime_error)
 
             ("iter,i",       po::value<size_t>(&(this->options.iteration_n)),    opt_iter_msg.c_str())
             ("classes,c",    po::value<size_t>(&(this->options.classes_n)),      opt_classes_msg.c_str())
+            ("classes-range", po::value<std::string>(&classes_range),            opt_classes_range_msg.c_str())
+            ("classes-split",                                                    opt_classes_split_msg.c_str())
             ("length,l",     po::value<size_t>(&(this->options.motif_l)),        opt_length_msg.c_str())
+            ("length-range", po::value<std::string>(&length_range),              opt_length_range_msg.c_str())
             ("flip",                                                             opt_flip_msg.c_str())
             ("centershift",                                                      opt_shift_center.c_str())
             ("bgclass",                                                          opt_bg_class_msg.c_str())
@@ -230,7 +1070,30 @@ void Application::set_options(int argn, char** argv) throw (std::runtime_error)
             ("nogui",                                                            opt_nogui_msg.c_str())
 
             ("seeding",      po::value<std::string>(&(this->options.seeding)),   opt_seeding_msg.c_str())
-            ("seed",         po::value<std::string>(&(this->options.seed)),      opt_seed_msg.c_str()) ;
+            ("seeding-library", po::value<std::string>(&(this->options.seeding_library)), opt_seeding_library_msg.c_str())
+            ("seed",         po::value<std::string>(&(this->options.seed)),      opt_seed_msg.c_str())
+            ("restarts",     po::value<size_t>(&(this->options.restarts_n)),     opt_restarts_msg.c_str())
+            ("warmstart-fraction", po::value<double>(&(this->options.warmstart_fraction)), opt_warmstart_msg.c_str())
+
+            ("threads",      po::value<size_t>(&(this->options.threads_n)),      opt_threads_msg.c_str())
+            ("fused",                                                            opt_fused_msg.c_str())
+            ("float",                                                            opt_float_msg.c_str())
+            ("sparse",       po::value<double>(&(this->options.sparse_threshold)), opt_sparse_msg.c_str())
+            ("shift-window", po::value<size_t>(&(this->options.shift_window)),   opt_shift_window_msg.c_str())
+            ("shift-threshold", po::value<double>(&(this->options.shift_threshold)), opt_shift_threshold_msg.c_str())
+            ("incremental",  po::value<double>(&(this->options.incremental_threshold)), opt_incremental_msg.c_str())
+            ("hard",                                                             opt_hard_msg.c_str())
+
+            ("stop",         po::value<std::string>(&stopping_rule),             opt_stop_msg.c_str())
+            ("tolerance",    po::value<double>(&(this->options.tolerance)),      opt_tolerance_msg.c_str())
+            ("accelerate",   po::value<std::string>(&(this->options.acceleration)), opt_accelerate_msg.c_str())
+
+            ("batch",        po::value<size_t>(&(this->options.batch_size)),     opt_batch_msg.c_str())
+            ("step-decay",   po::value<double>(&(this->options.step_decay)),     opt_step_decay_msg.c_str())
+
+            ("checkpoint",   po::value<std::string>(&(this->options.checkpoint)), opt_checkpoint_msg.c_str())
+            ("checkpoint-every", po::value<size_t>(&(this->options.checkpoint_every)), opt_checkpoint_every_msg.c_str())
+            ("resume",       po::value<std::string>(&(this->options.resume)),    opt_resume_msg.c_str()) ;
 
     // parse
     try
@@ -250,7 +1113,8 @@ void Application::set_options(int argn, char** argv) throw (std::runtime_error)
     }
     // seeding
     else if((this->options.seeding.find(",") == std::string::npos) and // this is not a motif file
-            (this->options.seeding != seeding_random))                 // this is not a reconized method
+            (this->options.seeding != seeding_random) and              // this is not a reconized method
+            (this->options.seeding != seeding_kmer))
     {   std::string msg("error while parsing options! unrecognized seeding method (--seeding!)!") ;
         throw(std::runtime_error(msg)) ;
     }
@@ -273,6 +1137,134 @@ void Application::set_options(int argn, char** argv) throw (std::runtime_error)
     {   std::string msg("error while parsing options! --to cannot be negative!") ;
         throw(std::runtime_error(msg)) ;
     }
+    // number of threads
+    else if(this->options.threads_n == 0)
+    {   std::string msg("error while parsing options! --threads should at least be 1!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // sparse mode
+    else if(this->options.sparse_threshold < 0. or this->options.sparse_threshold >= 1.)
+    {   std::string msg("error while parsing options! --sparse should be in [0,1)!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.sparse_threshold > 0. and (vm.count("fused") or this->options.batch_size))
+    {   std::string msg("error while parsing options! --sparse cannot be used with --fused nor --batch!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // shift band
+    else if(this->options.shift_threshold < 0. or this->options.shift_threshold >= 1.)
+    {   std::string msg("error while parsing options! --shift-threshold should be in [0,1)!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if((vm.count("shift-window") or this->options.shift_threshold > 0.) and
+            (this->options.sparse_threshold > 0. or this->options.batch_size))
+    {   std::string msg("error while parsing options! --shift-window and --shift-threshold cannot be used "
+                        "with --sparse nor --batch!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // incremental EM
+    else if(this->options.incremental_threshold < 0. or this->options.incremental_threshold >= 1.)
+    {   std::string msg("error while parsing options! --incremental should be in [0,1)!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.incremental_threshold > 0. and
+            (this->options.sparse_threshold > 0. or this->options.batch_size))
+    {   std::string msg("error while parsing options! --incremental cannot be used with --sparse nor --batch!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // classification EM
+    else if(vm.count("hard") and
+            (vm.count("fused") or this->options.sparse_threshold > 0. or
+             this->options.incremental_threshold > 0. or this->options.batch_size))
+    {   std::string msg("error while parsing options! --hard cannot be used with --fused, --sparse, "
+                        "--incremental nor --batch!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // stopping rule
+    else if(stopping_rule != stop_delta and
+            stopping_rule != stop_loglik and
+            stopping_rule != stop_both)
+    {   std::string msg("error while parsing options! unrecognized stopping rule (--stop)!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.tolerance < 0.)
+    {   std::string msg("error while parsing options! --tolerance cannot be negative!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // acceleration
+    else if(this->options.acceleration != accelerate_none and
+            this->options.acceleration != accelerate_squarem)
+    {   std::string msg("error while parsing options! unrecognized acceleration method (--accelerate)!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // stepwise EM
+    else if(this->options.step_decay <= 0.5 or this->options.step_decay > 1.)
+    {   std::string msg("error while parsing options! --step-decay should be in (0.5,1]!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.batch_size and this->options.acceleration != accelerate_none)
+    {   std::string msg("error while parsing options! --accelerate cannot be used with --batch!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.batch_size and (vm.count("fused") or stopping_rule != stop_delta))
+    {   std::string msg("error while parsing options! --fused and --stop cannot be used with --batch!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // restarts
+    else if(this->options.restarts_n == 0)
+    {   std::string msg("error while parsing options! --restarts should at least be 1!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.restarts_n > 1 and this->options.seeding != seeding_random)
+    {   std::string msg("error while parsing options! --restarts requires a random seeding (--seeding)!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.restarts_n > 1 and this->options.batch_size)
+    {   std::string msg("error while parsing options! --restarts cannot be used with --batch!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // warm start
+    else if(this->options.warmstart_fraction <= 0. or this->options.warmstart_fraction > 1.)
+    {   std::string msg("error while parsing options! --warmstart-fraction should be in (0,1]!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.warmstart_fraction < 1. and
+            (this->options.batch_size or this->options.resume.size() or
+             classes_range != "" or length_range != ""))
+    {   std::string msg("error while parsing options! --warmstart-fraction cannot be used with --batch, "
+                        "--resume, --classes-range nor --length-range!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(this->options.seeding_library.size() and
+            (vm.count("seeding") or this->options.restarts_n > 1 or this->options.batch_size or
+             this->options.resume.size() or classes_range != "" or length_range != ""))
+    {   std::string msg("error while parsing options! --seeding-library cannot be used with --seeding, "
+                        "--restarts, --batch, --resume, --classes-range nor --length-range!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // model selection
+    else if(vm.count("classes-split") and classes_range == "")
+    {   std::string msg("error while parsing options! --classes-split requires --classes-range!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(vm.count("classes-split") and length_range != "")
+    {   std::string msg("error while parsing options! --classes-split cannot be used with --length-range!") ;
+        throw std::runtime_error(msg) ;
+    }
+    else if((classes_range != "" or length_range != "") and
+            (this->options.seeding.find(",") != std::string::npos or this->options.restarts_n > 1 or
+             this->options.batch_size or this->options.checkpoint.size() or this->options.resume.size()))
+    {   std::string msg("error while parsing options! --classes-range and --length-range cannot be used "
+                        "with motif files (--seeding), --restarts, --batch, --checkpoint nor --resume!") ;
+        throw std::runtime_error(msg) ;
+    }
+    // checkpoints
+    else if((this->options.checkpoint.size() or this->options.resume.size()) and
+            (this->options.restarts_n > 1 or this->options.batch_size))
+    {   std::string msg("error while parsing options! --checkpoint and --resume cannot be used "
+                        "with --restarts nor --batch!") ;
+        throw std::runtime_error(msg) ;
+    }
 
     if(vm.count("help"))    { std::cout <<    desc << std::endl ; this->exit_code = EXIT_FAILURE ; }
     if(vm.count("version")) { std::cout << version << std::endl ; this->exit_code = EXIT_FAILURE ; }
@@ -281,6 +1273,32 @@ void Application::set_options(int argn, char** argv) throw (std::runtime_error)
     if(vm.count("flip"))    { this->options.center_shift = true ; }
     if(vm.count("bgclass")) { this->options.bg_class     = true ; }
     if(vm.count("nogui"))   { this->options.nogui        = true ; }
+    if(vm.count("fused"))   { this->options.fused        = true ; }
+    if(vm.count("float"))   { this->options.use_float    = true ; }
+    if(vm.count("hard"))    { this->options.hard         = true ; }
+    if(vm.count("classes-split")) { this->options.classes_split = true ; }
+    if(stopping_rule == stop_loglik) { this->options.stopping_rule = Constants::stopping_rules::LOG_LIKELIHOOD ; }
+    if(stopping_rule == stop_both)   { this->options.stopping_rule = Constants::stopping_rules::BOTH ; }
+
+    // the model selection ranges, as <from>:<to>
+    if(classes_range != "")
+    {   try
+        {   parse_range(classes_range, this->options.classes_from, this->options.classes_to) ; }
+        catch(std::invalid_argument&)
+        {   std::string msg("error while parsing options! --classes-range should be a non-empty range "
+                            "given as <from>:<to>, starting at least at 1!") ;
+            throw std::runtime_error(msg) ;
+        }
+    }
+    if(length_range != "")
+    {   try
+        {   parse_range(length_range, this->options.length_from, this->options.length_to) ; }
+        catch(std::invalid_argument&)
+        {   std::string msg("error while parsing options! --length-range should be a non-empty range "
+                            "given as <from>:<to>, starting at least at 1!") ;
+            throw std::runtime_error(msg) ;
+        }
+    }
 
     // make --from and --to 0-based
     this->options.from-- ;
@@ -360,7 +1378,8 @@ void Application::displayMotifs(const std::vector<Matrix2D<double>>& motifs,
 }
 
 
-void Application::write_results(const EMSequenceEngine& em) const throw (std::runtime_error)
+template<class T>
+void Application::write_results(const EMSequenceEngine<T>& em) const throw (std::runtime_error)
 {   try
     {   this->write_motifs(em) ;
         this->write_post_prob(em) ;
@@ -371,7 +1390,8 @@ void Application::write_results(const EMSequenceEngine& em) const throw (std::ru
     {   throw e ; }
 }
 
-void Application::write_motifs(const EMSequenceEngine& em) const throw (std::runtime_error)
+template<class T>
+void Application::write_motifs(const EMSequenceEngine<T>& em) const throw (std::runtime_error)
 {
     std::vector<Matrix2D<double>> motifs = em.get_motifs() ;
 
@@ -394,9 +1414,10 @@ void Application::write_motifs(const EMSequenceEngine& em) const throw (std::run
 
 }
 
-void Application::write_post_prob(const EMSequenceEngine& em) const throw (std::runtime_error)
+template<class T>
+void Application::write_post_prob(const EMSequenceEngine<T>& em) const throw (std::runtime_error)
 {
-    Matrix4D<double> post_prob = em.get_post_prob() ;
+    Matrix4D<T> post_prob = em.get_post_prob() ;
 
     char file_name[512] ;
     sprintf(file_name, "%s_postprob.mat", this->options.prefix.c_str()) ;
@@ -412,7 +1433,8 @@ void Application::write_post_prob(const EMSequenceEngine& em) const throw (std::
     f_post_prob.close() ;
 }
 
-void Application::write_class_prob(const EMSequenceEngine& em) const throw (std::runtime_error)
+template<class T>
+void Application::write_class_prob(const EMSequenceEngine<T>& em) const throw (std::runtime_error)
 {
     Matrix3D<double> class_prob = em.get_class_prob() ;
 
@@ -430,7 +1452,8 @@ void Application::write_class_prob(const EMSequenceEngine& em) const throw (std:
     f_class_prob.close() ;
 }
 
-void Application::write_class_prob_total(const EMSequenceEngine& em) const throw (std::runtime_error)
+template<class T>
+void Application::write_class_prob_total(const EMSequenceEngine<T>& em) const throw (std::runtime_error)
 {
     std::vector<double> class_prob_total = em.get_class_prob_total() ;
 
@@ -448,6 +1471,85 @@ void Application::write_class_prob_total(const EMSequenceEngine& em) const throw
     f_class_prob_total.close() ;
 }
 
+void Application::write_trace(const std::vector<double>& log_likelihoods,
+                              const std::vector<double>& deltas,
+                              size_t n_iter_start) const throw (std::runtime_error)
+{
+    char file_name[512] ;
+    sprintf(file_name, "%s_trace.mat", this->options.prefix.c_str()) ;
+
+    std::string file_name_str(file_name) ;
+    std::ofstream f_trace(file_name_str) ;
+    if(f_trace.fail())
+    {   char msg[1024] ;
+        sprintf(msg, "could not write trace in %s", file_name_str.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+    // full precision, the successive log likelihoods are close
+    f_trace << std::setprecision(std::numeric_limits<double>::max_digits10) ;
+    for(size_t i=0; i<log_likelihoods.size(); i++)
+    {   f_trace << n_iter_start+i+1 << '\t' << log_likelihoods[i] << '\t' << deltas[i] << std::endl ; }
+    f_trace.close() ;
+}
+
+
+void Application::write_model_selection(const std::vector<std::vector<double>>& table) const throw (std::runtime_error)
+{
+    char file_name[512] ;
+    sprintf(file_name, "%s_models.mat", this->options.prefix.c_str()) ;
+
+    std::string file_name_str(file_name) ;
+    std::ofstream f_table(file_name_str) ;
+    if(f_table.fail())
+    {   char msg[1024] ;
+        sprintf(msg, "could not write model selection in %s", file_name_str.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+    f_table << std::setprecision(std::numeric_limits<double>::max_digits10) ;
+    for(const auto& row : table)
+    {   for(size_t i=0; i<row.size(); i++)
+        {   f_table << row[i] << (i+1 < row.size() ? '\t' : '\n') ; }
+    }
+    f_table.close() ;
+}
+
+
+template<class T>
+void Application::write_post_prob_online(EMSequenceEngine<T>& em,
+                                         SequenceBatchReader& reader) const throw (std::runtime_error)
+{
+    char file_name[512] ;
+    sprintf(file_name, "%s_postprob.mat", this->options.prefix.c_str()) ;
+    std::string file_name_str(file_name) ;
+    std::ofstream f_post_prob(file_name_str) ;
+    if(f_post_prob.fail())
+    {   char msg[1024] ;
+        sprintf(msg, "could not write posterior prob in %s", file_name_str.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+
+    // same number format as Matrix4D::print()
+    f_post_prob.setf(std::ios::left) ;
+    f_post_prob << std::setprecision(4) << std::fixed ;
+    Matrix2D<char> batch ;
+    reader.rewind() ;
+    while(reader.get_next(batch))
+    {   em.set_sequences(batch) ;
+        em.update_post_prob() ;
+        Matrix4D<T> post_prob = em.get_post_prob() ;
+        std::vector<size_t> dim = post_prob.get_dim() ;
+        for(size_t i=0; i<dim[0]; i++)
+        {   for(size_t k=0; k<dim[1]; k++)
+            {   for(size_t s=0; s<dim[2]; s++)
+                {   for(size_t f=0; f<dim[3]; f++)
+                    {   f_post_prob << std::setw(8) << post_prob(i,k,s,f) << ' ' ; }
+                }
+            }
+            f_post_prob << std::endl ;
+        }
+    }
+    f_post_prob.close() ;
+}
 
 
 std::vector<std::string> split(const std::string& str, char delim)
@@ -462,6 +1564,20 @@ std::vector<std::string> split(const std::string& str, char delim)
 }
 
 
+void parse_range(const std::string& range, size_t& from, size_t& to) throw (std::invalid_argument)
+{   std::vector<std::string> bounds = split(range, ':') ;
+    // only digits are accepted
+    if(bounds.size() != 2 or bounds[0].empty() or bounds[1].empty() or
+       bounds[0].find_first_not_of("0123456789") != std::string::npos or
+       bounds[1].find_first_not_of("0123456789") != std::string::npos)
+    {   throw std::invalid_argument("error! a range should be given as <from>:<to>!") ; }
+    from = std::stoul(bounds[0]) ;
+    to   = std::stoul(bounds[1]) ;
+    if(from == 0 or from > to)
+    {   throw std::invalid_argument("error! a range should be non-empty and start at least at 1!") ; }
+}
+
+
 Matrix2D<char> load_fasta_into_matrix(const std::string& file_address, int from, int to) throw (std::invalid_argument, std::runtime_error)
 {
 
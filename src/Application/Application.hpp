@@ -7,8 +7,14 @@
 #include <unordered_map>
 #include <boost/program_options.hpp>
 #include <stdexcept> // std::runtime_error, std::invalid_argument
+#include <memory>    // std::shared_ptr
+#include <mutex>     // std::mutex
+#include <random>    // std::mt19937
 
 #include <Clustering/EMSequenceEngine.hpp>
+#include <Application/SequenceBatchReader.hpp>
+#include <GUI/ConsoleProgressBar/ConsoleProgressBar.hpp>
+#include <Utility/PackedSequenceSet.hpp>
 #include <Utility/Constants.hpp> // Constants::clustering_codes
 
 
@@ -39,10 +45,35 @@ struct options
      * \brief the number of classes to optimize.
      */
     size_t classes_n ;
+    /*!
+     * \brief the smallest number of classes of the model
+     * selection sweep, 0 if there is no sweep.
+     */
+    size_t classes_from ;
+    /*!
+     * \brief the largest number of classes of the model
+     * selection sweep, 0 if there is no sweep.
+     */
+    size_t classes_to ;
+    /*!
+     * \brief whether each model of the sweep is seeded by
+     * splitting a motif of the previous one.
+     */
+    bool classes_split ;
     /*!
      * \brief the motif length.
      */
     size_t motif_l ;
+    /*!
+     * \brief the smallest motif length of the model
+     * selection sweep, 0 if there is no sweep.
+     */
+    size_t length_from ;
+    /*!
+     * \brief the largest motif length of the model
+     * selection sweep, 0 if there is no sweep.
+     */
+    size_t length_to ;
     /*!
      * \brief whether the reverse strand should be searched.
      */
@@ -70,6 +101,22 @@ struct options
      * \brief the seeding method to use.
      */
     std::string seeding ;
+    /*!
+     * \brief the directory containing the library of motifs
+     * to seed the classes with, empty if no library is used.
+     */
+    std::string seeding_library ;
+    /*!
+     * \brief the number of classifications to run from
+     * different random starting points.
+     */
+    size_t restarts_n ;
+    /*!
+     * \brief the fraction of the sequences on which the
+     * motifs are first trained, 1 to train them on all the
+     * sequences from the start.
+     */
+    double warmstart_fraction ;
     // results related
     /*!
      * \brief the prefix for all the files which will
@@ -81,6 +128,88 @@ struct options
      * \brief whether the GUI should be hidden.
      */
     bool nogui ;
+    // computations
+    /*!
+     * \brief the number of threads to use.
+     */
+    size_t threads_n ;
+    /*!
+     * \brief whether the E-step and the M-step should be run
+     * in a single pass over the sequences.
+     */
+    bool fused ;
+    /*!
+     * \brief whether the likelihoods and posterior probabilities
+     * should be stored as float instead of double.
+     */
+    bool use_float ;
+    /*!
+     * \brief the posterior probability under which the states
+     * of a sequence are pruned, 0 to keep all the states.
+     */
+    double sparse_threshold ;
+    /*!
+     * \brief the number of shifts on each side of the central
+     * shift which are scored.
+     */
+    size_t shift_window ;
+    /*!
+     * \brief the minimal prior probability of the shifts
+     * which are scored, 0 to score all the shifts.
+     */
+    double shift_threshold ;
+    /*!
+     * \brief the largest posterior probability change under
+     * which a sequence is frozen, 0 to score all the sequences
+     * at each iteration.
+     */
+    double incremental_threshold ;
+    /*!
+     * \brief whether each sequence should be assigned to a single
+     * state (classification EM).
+     */
+    bool hard ;
+    // convergence
+    /*!
+     * \brief the rule used to decide whether the classification
+     * converged.
+     */
+    Constants::stopping_rules stopping_rule ;
+    /*!
+     * \brief the relative log likelihood tolerance used by the
+     * log likelihood stopping rule.
+     */
+    double tolerance ;
+    /*!
+     * \brief the method used to accelerate the convergence.
+     */
+    std::string acceleration ;
+    // online classification
+    /*!
+     * \brief the number of sequences per mini-batch of the
+     * stepwise EM, 0 to load all the sequences at once.
+     */
+    size_t batch_size ;
+    /*!
+     * \brief the decay exponent of the stepwise EM step sizes.
+     */
+    double step_decay ;
+    // checkpoints
+    /*!
+     * \brief the address of the checkpoint file to write, empty
+     * if no checkpoint should be written.
+     */
+    std::string checkpoint ;
+    /*!
+     * \brief the number of iterations between two checkpoints,
+     * 0 to only write one upon termination request (SIGTERM).
+     */
+    size_t checkpoint_every ;
+    /*!
+     * \brief the address of a checkpoint file to resume the
+     * classification from, empty to start a new one.
+     */
+    std::string resume ;
 } ;
 
 
@@ -139,6 +268,211 @@ class Application
 
     private:
         // methods
+        /*!
+         * \brief Runs the classification procedure on the given sequences,
+         * for the given number of iterations or until convergence, and
+         * take care of returning the results properly. This is the body
+         * of run(), once the data are loaded.
+         * \tparam T the type used to store the sequence likelihoods and
+         * posterior probabilities.
+         * \param sequences the sequences to classify.
+         * \throw std::invalid_argument or std::runtime_error at least
+         * in case of error during the process.
+         * \return EXIT_SUCCESS upon success (convergence or maximum number of
+         * iteration reached), EXIT_FAILURE otherwise.
+         */
+        template<class T>
+        int classify(const Matrix2D<char>& sequences) throw (std::invalid_argument, std::runtime_error) ;
+
+        /*!
+         * \brief Runs the classification procedure on the given sequences
+         * once for each number of classes in [this->options.classes_from,
+         * this->options.classes_to] and each motif length in
+         * [this->options.length_from, this->options.length_to] (or the
+         * single values given by this->options.classes_n and
+         * this->options.motif_l), and takes care of returning the results
+         * properly. The sequences and the prefix sums of their background
+         * log probabilities are computed once and are shared by all the
+         * models, which are run concurrently if several threads are given.
+         * With this->options.classes_split, the models are instead run one
+         * after the other, each being seeded by splitting the most probable
+         * motif of the previous one (see split_motifs()). The full sequence
+         * log likelihood (see
+         * EMSequenceEngine::compute_sequence_log_likelihood()), BIC and AIC
+         * of each model are reported and the results of the model with the
+         * lowest BIC are written.
+         * \tparam T the type used to store the sequence likelihoods and
+         * posterior probabilities.
+         * \param sequences the sequences to classify.
+         * \throw std::invalid_argument or std::runtime_error at least
+         * in case of error during the process.
+         * \return EXIT_SUCCESS upon success (all models converged or
+         * reached the maximum number of iterations).
+         */
+        template<class T>
+        int classify_sweep(const Matrix2D<char>& sequences) throw (std::invalid_argument, std::runtime_error) ;
+
+        /*!
+         * \brief Computes starting motifs for a model with one more
+         * class than the given classifier instance : the motif of the
+         * trained class with the highest overall probability is
+         * replaced by two perturbed copies, the probabilities of each
+         * copy being multiplied by 1+u and 1-u respectively, u being
+         * drawn uniformly in [-Constants::split_noise,
+         * Constants::split_noise] for each base and position, and
+         * renormalized.
+         * \tparam T the type used to store the sequence likelihoods and
+         * posterior probabilities.
+         * \param em the classifier instance.
+         * \param generator the random number generator to draw the
+         * perturbations with.
+         * \return the motifs of the trained classes, the background
+         * class excluded.
+         */
+        template<class T>
+        std::vector<Matrix2D<double>> split_motifs(const EMSequenceEngine<T>& em,
+                                                   std::mt19937& generator) const ;
+
+        /*!
+         * \brief Selects the starting motifs among the motifs stored in
+         * the files of the directory this->options.seeding_library. Each
+         * motif is normalized, mixed with the background probabilities
+         * computed from the sequences (with a weight of
+         * Constants::library_bg_weight) and fitted to
+         * this->options.motif_l : the motifs too long are reduced to their
+         * most informative window and the motifs too short are padded, on
+         * both sides, with the background probabilities. The motifs are
+         * then ranked according to their best site enrichment : the
+         * average log-odds score of their best site in each sequence (see
+         * dna::best_site_log_odds()) minus the same average over as many
+         * sequences drawn from the background, using
+         * this->options.seed. The this->options.classes_n best ones are
+         * kept. The library is split in batches of motifs scored
+         * concurrently if several threads are given.
+         * \param sequences the sequences to score the motifs against.
+         * \param n_threads the number of threads to use.
+         * \throw std::runtime_error if the directory cannot be read, if a
+         * file does not contain a motif or if the library contains fewer
+         * motifs than requested.
+         * \return the selected motifs, from the best to the worst.
+         */
+        std::vector<Matrix2D<double>> select_library_motifs(const PackedSequenceSet& sequences,
+                                                            size_t n_threads) const throw (std::runtime_error) ;
+
+        /*!
+         * \brief Creates a classifier instance according to the options.
+         * \tparam T the type used to store the sequence likelihoods and
+         * posterior probabilities.
+         * \param sequences the sequences to classify, possibly shared
+         * with other instances.
+         * \param seed the seed of the instance random number generator.
+         * \param n_threads the number of threads the instance uses.
+         * \param warm_start whether the instance motifs and class
+         * probabilities should first be trained on a subsample of the
+         * sequences (see train_on_subsample()) if
+         * this->options.warmstart_fraction is lower than 1.
+         * \throw std::invalid_argument or std::runtime_error if the
+         * instance cannot be constructed.
+         * \return a pointer to the instance, to delete after use. When
+         * resuming from a checkpoint, the instance is restored from it,
+         * including its settings, and the seed is not used.
+         */
+        template<class T>
+        EMSequenceEngine<T>* create_engine(std::shared_ptr<const PackedSequenceSet> sequences,
+                                           const std::string& seed,
+                                           size_t n_threads,
+                                           bool warm_start=true) const throw (std::invalid_argument, std::runtime_error) ;
+
+        /*!
+         * \brief Trains motifs on a random subsample of the given sequences,
+         * containing a fraction this->options.warmstart_fraction of them
+         * (at least this->options.classes_n sequences). The subsample is
+         * drawn without replacement using the given seed. A classifier
+         * instance is created on the subsample, according to the options,
+         * and is run for at most this->options.iteration_n iterations or
+         * until convergence.
+         * \tparam T the type used to store the sequence likelihoods and
+         * posterior probabilities.
+         * \param sequences the sequences to draw the subsample from.
+         * \param seed the seed of the random number generator used to draw
+         * the subsample and of the instance.
+         * \param n_threads the number of threads the instance uses.
+         * \param class_prob a matrix in which the trained class
+         * probabilities are stored.
+         * \throw std::invalid_argument or std::runtime_error if the
+         * instance cannot be constructed.
+         * \return the motifs of the trained classes, the background class
+         * excluded.
+         */
+        template<class T>
+        std::vector<Matrix2D<double>> train_on_subsample(std::shared_ptr<const PackedSequenceSet> sequences,
+                                                         const std::string& seed,
+                                                         size_t n_threads,
+                                                         Matrix3D<double>& class_prob) const throw (std::invalid_argument, std::runtime_error) ;
+
+        /*!
+         * \brief Sets the classification procedure options of the given
+         * classifier instance (fused, sparse, shift band, incremental and
+         * hard modes, stopping rule and acceleration).
+         * \tparam T the type used to store the sequence likelihoods and
+         * posterior probabilities.
+         * \param em the classifier instance.
+         * \throw std::invalid_argument if the options cannot be combined.
+         */
+        template<class T>
+        void configure_engine(EMSequenceEngine<T>& em) const throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Runs the given classifier instance for the given number
+         * of iterations or until convergence.
+         * \tparam T the type used to store the sequence likelihoods and
+         * posterior probabilities.
+         * \param em the classifier instance.
+         * \param n_iter the number of iterations, incremented at each
+         * iteration.
+         * \param log_likelihoods a vector to which the data log likelihood
+         * of each iteration is appended.
+         * \param deltas a vector to which the largest posterior probability
+         * change of each iteration is appended.
+         * \param bar a progress bar, updated at each iteration.
+         * \param bar_mutex a mutex guarding the progress bar, which may be
+         * shared by several concurrent runs.
+         * If a checkpoint file is given, the instance state is written
+         * every this->options.checkpoint_every iterations. Upon termination
+         * request (SIGTERM), the procedure stops after the current iteration
+         * and the state is written.
+         * \return the code returned by the last iteration.
+         */
+        template<class T>
+        int optimize(EMSequenceEngine<T>& em,
+                     size_t& n_iter,
+                     std::vector<double>& log_likelihoods,
+                     std::vector<double>& deltas,
+                     ConsoleProgressBar& bar,
+                     std::mutex& bar_mutex) const ;
+
+        /*!
+         * \brief Runs the classification procedure using a stepwise
+         * (online) EM, for the given number of passes over the data or
+         * until convergence, and takes care of returning the results
+         * properly. The sequences are streamed from the data file in
+         * mini-batches of this->options.batch_size sequences such that
+         * only one batch is in memory at a time. The batch of index t
+         * (over all passes) is given a step size (t+1)^-step_decay. The
+         * convergence is reached when the relative change of the data
+         * log likelihood summed over a pass is at most
+         * this->options.tolerance. Once done, the posterior probabilities
+         * are computed in one extra pass and written on the fly.
+         * \tparam T the type used to store the sequence likelihoods and
+         * posterior probabilities.
+         * \throw std::invalid_argument or std::runtime_error at least
+         * in case of error during the process.
+         * \return EXIT_SUCCESS upon success (convergence or maximum number of
+         * iteration reached), EXIT_FAILURE otherwise.
+         */
+        template<class T>
+        int classify_online() throw (std::invalid_argument, std::runtime_error) ;
+
         /*!
          * \brief Dumps the posterior probabilies, class probabilities and
          * motif of the given instance to files with their addresses starting with
@@ -147,7 +481,8 @@ class Application
          * and the motifs to <prefix>_motif_<class_number>.mat.
          * \param em the sequence classifier instance of interest.
          */
-        void write_results(const EMSequenceEngine& em) const throw (std::runtime_error) ;
+        template<class T>
+        void write_results(const EMSequenceEngine<T>& em) const throw (std::runtime_error) ;
 
         /*!
          * \brief Dumps the motifs of the given instance to files named
@@ -155,28 +490,75 @@ class Application
          * as there are classes.
          * \param em the sequence classifier instance of interest.
          */
-        void write_motifs(const EMSequenceEngine& em) const throw (std::runtime_error) ;
+        template<class T>
+        void write_motifs(const EMSequenceEngine<T>& em) const throw (std::runtime_error) ;
 
         /*!
          * \brief Dumps the posterior probabilities of the given instance to
          * a file named <this->options.suffix>_postprob.mat.
          * \param em the sequence classifier instance of interest.
          */
-        void write_post_prob(const EMSequenceEngine& em) const throw (std::runtime_error) ;
+        template<class T>
+        void write_post_prob(const EMSequenceEngine<T>& em) const throw (std::runtime_error) ;
 
         /*!
          * \brief Dumps the class probabilities of the given instance to
          * a file named <this->options.suffix>_classprobtotal.mat.
          * \param em the sequence classifier instance of interest.
          */
-        void write_class_prob(const EMSequenceEngine& em) const throw (std::runtime_error) ;
+        template<class T>
+        void write_class_prob(const EMSequenceEngine<T>& em) const throw (std::runtime_error) ;
 
         /*!
          * \brief Dumps the overall class probabilities of the given instance to
          * a file named <this->options.suffix>_classprobtotal.mat.
          * \param em the sequence classifier instance of interest.
          */
-        void write_class_prob_total(const EMSequenceEngine& em) const throw (std::runtime_error) ;
+        template<class T>
+        void write_class_prob_total(const EMSequenceEngine<T>& em) const throw (std::runtime_error) ;
+
+        /*!
+         * \brief Dumps the per iteration trace of the classification to a
+         * file named <this->options.prefix>_trace.mat, with one row per
+         * iteration and 3 columns : the iteration number, the data log
+         * likelihood computed during the E-step and the largest change of
+         * a posterior probability.
+         * \param log_likelihoods the data log likelihood of each iteration.
+         * \param deltas the largest posterior probability change of each
+         * iteration.
+         * \param n_iter_start the number of iterations run before the first
+         * traced one, when the classification was resumed from a checkpoint.
+         */
+        void write_trace(const std::vector<double>& log_likelihoods,
+                         const std::vector<double>& deltas,
+                         size_t n_iter_start=0) const throw (std::runtime_error) ;
+
+        /*!
+         * \brief Dumps the model selection summary to a file named
+         * <this->options.prefix>_models.mat, with one row per model and
+         * 7 columns : the number of classes, the motif length, the number
+         * of iterations run, the full sequence log likelihood, the number
+         * of free parameters, the BIC and the AIC.
+         * \param table the rows of the file.
+         */
+        void write_model_selection(const std::vector<std::vector<double>>& table) const throw (std::runtime_error) ;
+
+        /*!
+         * \brief Computes the posterior probabilities of the sequences
+         * streamed by the given reader, given the model of the given
+         * instance, and dumps them to a file named
+         * <this->options.prefix>_postprob.mat as they are computed. The
+         * file contains one row per sequence, the posterior probability
+         * of class k, shift s and flip state f being in column
+         * (k*n_shift + s)*n_flip + f.
+         * \param em the sequence classifier instance of interest. Its
+         * sequences are replaced by the streamed batches.
+         * \param reader the reader streaming the sequences, rewound before
+         * use.
+         */
+        template<class T>
+        void write_post_prob_online(EMSequenceEngine<T>& em,
+                                    SequenceBatchReader& reader) const throw (std::runtime_error) ;
 
 
         /*!
@@ -239,6 +621,17 @@ class Application
 std::vector<std::string> split(const std::string& str, char delim) ;
 
 
+/*!
+ * \brief Parses a range of positive integers given as <from>:<to>.
+ * \param range the range.
+ * \param from the first value of the range.
+ * \param to the last value of the range (included).
+ * \throw std::invalid_argument if the range is not properly formatted,
+ * if from is 0 or if it is larger than to.
+ */
+void parse_range(const std::string& range, size_t& from, size_t& to) throw (std::invalid_argument) ;
+
+
 /*!
  * \brief Loads the content of a fasta file and stores the data in a
  * character matrix where each row contains one sequence.
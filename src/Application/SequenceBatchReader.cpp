@@ -0,0 +1,128 @@
+#include "SequenceBatchReader.hpp"
+
+#include <string>
+#include <vector>
+#include <sstream>   // istringstream
+#include <stdexcept> // std::runtime_error, std::invalid_argument
+
+#include <FileTools/include/FASTAFileReader.hpp> // FASTAFileReader
+#include <FileTools/include/FASTA_element.hpp>   // FASTA_element
+#include <Matrix/Matrix2D.hpp>
+
+
+SequenceBatchReader::SequenceBatchReader(const std::string& file_address,
+                                         bool fasta,
+                                         size_t batch_size,
+                                         int from,
+                                         int to) throw (std::invalid_argument, std::runtime_error)
+    : _file_address(file_address), _fasta(fasta), _batch_size(batch_size), _from(from), _to(to),
+      _l_seq(0), _n_seq_read(0), _fasta_reader(), _matrix_file()
+{   // only accepted negative value is -1
+    if(this->_batch_size == 0)
+    {   throw std::invalid_argument("error! the batch size should at least be 1!") ; }
+    else if(this->_from < -1)
+    {   throw std::invalid_argument("from parameter is negative!") ; }
+    else if(this->_to < -1)
+    {   throw std::invalid_argument("to parameter is negative!") ; }
+
+    if(this->_fasta)
+    {   this->_fasta_reader.set_file(this->_file_address) ; }
+    else
+    {   this->_matrix_file.open(this->_file_address, std::ifstream::in) ;
+        if(this->_matrix_file.fail())
+        {   char msg[BUFFER_SIZE] ;
+            sprintf(msg, "error! cannot open %s", this->_file_address.c_str()) ;
+            throw std::runtime_error(msg) ;
+        }
+    }
+}
+
+SequenceBatchReader::~SequenceBatchReader()
+{   if(this->_fasta)
+    {   this->_fasta_reader.close() ; }
+    else
+    {   this->_matrix_file.close() ; }
+}
+
+bool SequenceBatchReader::get_next(Matrix2D<char>& batch) throw (std::runtime_error, std::invalid_argument)
+{   std::vector<std::string> sequences ;
+    sequences.reserve(this->_batch_size) ;
+    std::string sequence ;
+    while(sequences.size() < this->_batch_size and this->get_next_sequence(sequence))
+    {   // all the sequences should have the length of the first one
+        if(this->_l_seq == 0)
+        {   this->_l_seq = sequence.size() ; }
+        else if(sequence.size() != this->_l_seq)
+        {   throw std::runtime_error("sequences have variable length!") ; }
+        sequences.push_back(sequence) ;
+    }
+    if(sequences.size() == 0)
+    {   return false ; }
+    this->_n_seq_read += sequences.size() ;
+
+    // check from to coordinates and set looping parameters
+    size_t loop_from = 0 ;
+    size_t loop_to   = this->_l_seq ;
+    if(this->_from != -1)
+    {   if(static_cast<size_t>(this->_from) > this->_l_seq)
+        {   throw std::runtime_error("from parameter is out of range!") ; }
+        loop_from = this->_from ;
+    }
+    if(this->_to != -1)
+    {   if(static_cast<size_t>(this->_to) >= this->_l_seq)
+        {   throw std::runtime_error("to parameter is out of range!") ; }
+        loop_to = this->_to + 1 ;
+    }
+
+    // store the sequences into the matrix
+    batch = Matrix2D<char>(sequences.size(), loop_to - loop_from) ;
+    for(size_t i=0; i<sequences.size(); i++)
+    {   for(size_t j=loop_from; j<loop_to; j++)
+        {   batch(i,j-loop_from) = sequences[i][j] ; }
+    }
+    return true ;
+}
+
+void SequenceBatchReader::rewind()
+{   if(this->_fasta)
+    {   this->_fasta_reader.seekg(0, std::ios::beg) ; }
+    else
+    {   this->_matrix_file.clear() ;
+        this->_matrix_file.seekg(0, std::ios::beg) ;
+    }
+    this->_n_seq_read = 0 ;
+}
+
+size_t SequenceBatchReader::get_nseq_read() const
+{   return this->_n_seq_read ; }
+
+bool SequenceBatchReader::get_next_sequence(std::string& sequence) throw (std::runtime_error, std::invalid_argument)
+{   sequence.clear() ;
+    // fasta file
+    if(this->_fasta)
+    {   FASTA_element* element = this->_fasta_reader.get_next() ;
+        if(element == nullptr)
+        {   return false ; }
+        sequence = element->sequence ;
+        delete element ;
+        return true ;
+    }
+
+    // character matrix, one sequence per row, one character per column
+    std::string line ;
+    if(not std::getline(this->_matrix_file, line))
+    {   return false ; }
+    else if(line.size() == 0)
+    {   // a single eol char at the end of the file
+        if(this->_matrix_file.peek() == EOF)
+        {   return false ; }
+        char msg[BUFFER_SIZE] ;
+        sprintf(msg, "format error! while reading %s (empty line)", this->_file_address.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+    std::istringstream line_ss(line) ;
+    char base ;
+    while(line_ss >> base)
+    {   sequence.push_back(base) ; }
+    return true ;
+}
@@ -0,0 +1,136 @@
+#ifndef SEQUENCEBATCHREADER_HPP
+#define SEQUENCEBATCHREADER_HPP
+
+#include <string>
+#include <fstream>
+#include <stdexcept> // std::runtime_error, std::invalid_argument
+
+#include <FileTools/include/FASTAFileReader.hpp>
+#include <Matrix/Matrix2D.hpp>
+
+
+/*!
+ * \brief The SequenceBatchReader class streams the sequences stored in a
+ * file, either a character matrix with one sequence per row or a fasta
+ * file, in batches of a given number of sequences. At most one batch is
+ * held in memory at a time, which allows to process files which would
+ * not fit in memory. The sequences should all have the same length.
+ */
+class SequenceBatchReader
+{
+    public:
+        // constructors
+        SequenceBatchReader() = delete ;
+        SequenceBatchReader(const SequenceBatchReader& other) = delete ;
+
+        /*!
+         * \brief Constructs an instance reading the given file.
+         * \param file_address the file address.
+         * \param fasta whether the file is a fasta file, a character
+         * matrix otherwise.
+         * \param batch_size the maximum number of sequences per batch.
+         * At least 1.
+         * \param from the first position in the sequences to consider
+         * (included, 0-based). -1 means from the beginning of the
+         * sequences.
+         * \param to the last position in the sequences to consider
+         * (included, 0-based). -1 means to the end of the sequences.
+         * \throw std::invalid_argument if the batch size is 0 or if from
+         * or to are negative (other than -1).
+         * \throw std::runtime_error if the file cannot be open.
+         */
+        SequenceBatchReader(const std::string& file_address,
+                            bool fasta,
+                            size_t batch_size,
+                            int from=-1,
+                            int to=-1) throw (std::invalid_argument, std::runtime_error) ;
+
+        /*!
+         * \brief Destructor. Closes the file.
+         */
+        ~SequenceBatchReader() ;
+
+        // methods
+        /*!
+         * \brief Reads the next batch of sequences. The last batch of
+         * the file may contain fewer sequences than the batch size.
+         * \param batch a matrix in which the sequences are stored, one
+         * per row. It is left unchanged if there is no sequence left.
+         * \throw std::runtime_error if the sequences do not all have
+         * the same length, if the file is not properly formatted or
+         * if from or to are out of range.
+         * \throw std::invalid_argument if a fasta entry is not
+         * properly formatted.
+         * \return whether a batch could be read, false once all the
+         * sequences have been read.
+         */
+        bool get_next(Matrix2D<char>& batch) throw (std::runtime_error, std::invalid_argument) ;
+
+        /*!
+         * \brief Moves back to the beginning of the file, the next call
+         * to get_next() returns the first batch.
+         */
+        void rewind() ;
+
+        /*!
+         * \brief Gets the number of sequences read since the
+         * construction or the last call to rewind().
+         * \return the number of sequences read.
+         */
+        size_t get_nseq_read() const ;
+
+    private:
+        // methods
+        /*!
+         * \brief Reads the next sequence in the file.
+         * \param sequence a string in which the sequence is stored.
+         * \throw std::runtime_error or std::invalid_argument if the
+         * file is not properly formatted.
+         * \return whether a sequence could be read.
+         */
+        bool get_next_sequence(std::string& sequence) throw (std::runtime_error, std::invalid_argument) ;
+
+        // fields
+        /*!
+         * \brief the file address.
+         */
+        std::string _file_address ;
+        /*!
+         * \brief whether the file is a fasta file.
+         */
+        bool _fasta ;
+        /*!
+         * \brief the maximum number of sequences per batch.
+         */
+        size_t _batch_size ;
+        /*!
+         * \brief the first position to use in the sequences
+         * (included, 0-based, -1 for the beginning).
+         */
+        int _from ;
+        /*!
+         * \brief the last position to use in the sequences
+         * (included, 0-based, -1 for the end).
+         */
+        int _to ;
+        /*!
+         * \brief the length of the sequences in the file, 0 until
+         * the first sequence is read.
+         */
+        size_t _l_seq ;
+        /*!
+         * \brief the number of sequences read since the beginning
+         * of the file.
+         */
+        size_t _n_seq_read ;
+        /*!
+         * \brief the reader used for fasta files.
+         */
+        FASTAFileReader _fasta_reader ;
+        /*!
+         * \brief the stream used for character matrix files.
+         */
+        std::ifstream _matrix_file ;
+} ;
+
+#endif // SEQUENCEBATCHREADER_HPP
@@ -8,76 +8,176 @@
 #include <numeric>
 #include <cmath>      // log(), log2(), exp()
 #include <algorithm>  // inner_product()
-#include <random>     // normal_distribution()
+#include <random>     // normal_distribution(), seed_seq, random_device
+#include <memory>     // std::shared_ptr, std::make_shared()
+#include <functional> // std::function, std::bind()
+#include <mutex>      // std::mutex, std::lock_guard
+#include <limits>     // std::numeric_limits
+#include <fstream>    // std::ifstream, std::ofstream
+#include <sstream>    // std::ostringstream, std::istringstream
+#include <cstdio>     // std::rename(), sprintf()
+#include <cstring>    // std::memcmp()
 
 #include "Matrix/Matrix2D.hpp"
 #include "Matrix/Matrix3D.hpp"
 #include "Matrix/Matrix4D.hpp"
-#include "Random/RandomNumberGenerator.hpp"
 #include "Random/BetaDistribution.hpp"
 #include "Utility/DNA_utility.hpp"
 #include "Utility/Constants.hpp"      // Constants
 #include "Utility/Vector_utility.hpp"
 #include "Utility/Utility.hpp"        // isEqual()
-#include "Statistics/Statistics.hpp"  // sd()
-
-EMSequenceEngine::EMSequenceEngine(const Matrix2D<char>& sequences,
-                                   size_t n_class,
-                                   size_t l_motif,
-                                   bool flip,
-                                   bool center_shift,
-                                   bool bg_class,
-                                   const std::string& seed,
-                                   const std::string& seeding) throw (std::invalid_argument)
-    : _sequences(sequences), _bg_prob({0.25, 0.25, 0.25, 0.25}), _n_iter(0),
-      _n_seq(_sequences.get_nrow()), _l_seq(_sequences.get_ncol()), _n_class(n_class),
+#include "Statistics/Statistics.hpp"  // sd(), log_normalize()
+#include "Parallel/ThreadPool.hpp"
+#include "Parallel/Reduction_utility.hpp" // tree_reduce()
+
+
+// the checkpoint file signature and format version
+static const char checkpoint_magic[8] = {'E', 'M', 'S', 'E', 'Q', 'C', 'K', 'P'} ;
+static const uint32_t checkpoint_version = 2 ;
+
+// writes the binary representation of a value to a stream
+template<class U>
+static void write_binary(std::ostream& stream, const U& value)
+{   stream.write(reinterpret_cast<const char*>(&value), sizeof(U)) ; }
+
+// reads the binary representation of a value from a stream
+template<class U>
+static U read_binary(std::istream& stream)
+{   U value = U() ;
+    stream.read(reinterpret_cast<char*>(&value), sizeof(U)) ;
+    return value ;
+}
+
+// whether two k-mers (2 bits codes, first base most significant) match with
+// at most k/8 mismatches when shifted by at most k/4 positions
+static bool kmers_similar(uint64_t a, uint64_t b, size_t k)
+{   size_t max_shift    = k / 4 ;
+    size_t max_mismatch = k / 8 ;
+    for(size_t shift=0; shift<=max_shift; shift++)
+    {   // a shifted to the right and to the left relative to b
+        for(size_t side=0; side<(shift ? 2 : 1); side++)
+        {   uint64_t x = side ? b : a ;
+            uint64_t y = side ? a : b ;
+            size_t mismatch = 0 ;
+            // the first k-shift bases of x against the last k-shift bases of y
+            for(size_t j=0; j<k-shift; j++)
+            {   mismatch += ((x >> (2*(j+shift))) & 3) != ((y >> (2*j)) & 3) ; }
+            if(mismatch <= max_mismatch)
+            {   return true ; }
+        }
+    }
+    return false ;
+}
+
+template<class T>
+EMSequenceEngine<T>::EMSequenceEngine(const Matrix2D<char>& sequences,
+                                      size_t n_class,
+                                      size_t l_motif,
+                                      bool flip,
+                                      bool center_shift,
+                                      bool bg_class,
+                                      const std::string& seed,
+                                      const std::string& seeding,
+                                      size_t n_threads) throw (std::invalid_argument)
+    : EMSequenceEngine(std::make_shared<PackedSequenceSet>(sequences),
+                       n_class, l_motif, flip, center_shift, bg_class, seed, seeding, n_threads)
+{}
+
+template<class T>
+EMSequenceEngine<T>::EMSequenceEngine(std::shared_ptr<const PackedSequenceSet> sequences,
+                                      size_t n_class,
+                                      size_t l_motif,
+                                      bool flip,
+                                      bool center_shift,
+                                      bool bg_class,
+                                      const std::string& seed,
+                                      const std::string& seeding,
+                                      size_t n_threads) throw (std::invalid_argument)
+    : _sequences(sequences), _bg_prob({0.25, 0.25, 0.25, 0.25}), _post_prob_delta(0.),
+      _log_likelihood(0.), _log_likelihood_prev(0.), _n_iter(0), _n_iter_start(0),
+      _n_seq(_sequences->get_nseq()), _l_seq(_sequences->get_lseq()), _n_class(n_class),
       _l_motif(l_motif), _n_shift(_l_seq-_l_motif+1), _n_flip(1+flip), _bg_class(bg_class),
-      _shift_center(center_shift)
+      _shift_center(center_shift), _n_threads(n_threads), _fused(false), _squarem(false), _squarem_step_max(1.),
+      _stopping_rule(Constants::stopping_rules::POST_PROB_DELTA), _tolerance(Constants::delta_max),
+      _sparse(false), _sparse_threshold(0.), _sparse_n_step(0), _sparse_full(false),
+      _shift_window(std::numeric_limits<size_t>::max()), _shift_threshold(0.),
+      _shift_from(0), _n_shift_band(_n_shift),
+      _incremental(false), _incremental_threshold(0.), _incremental_n_step(0), _incremental_full(false),
+      _hard(false)
 {
     // check number of classes and motif length
     if((this->_n_class == 0) or (this->_n_class > this->_n_seq) )
     {   throw std::invalid_argument("error! the number of classes should at least be 1, at most the number of sequences!") ; }
     else if((this->_l_motif == 0) or (this->_l_motif > this->_l_seq))
     {   throw std::invalid_argument("error! the motif length should be at least 1, at most the sequence length!") ; }
+    else if(this->_n_threads == 0)
+    {   throw std::invalid_argument("error! the number of threads should at least be 1!") ; }
 
-    // init the data structures
-    this->_likelihood      = Matrix4D<double>(this->_n_seq,   this->_n_class+bg_class, this->_n_shift, this->_n_flip) ;
-    this->_post_prob       = Matrix4D<double>(this->_n_seq,   this->_n_class+bg_class, this->_n_shift, this->_n_flip) ;
+    // init the data structures, the likelihood are only allocated
+    // before the first EM step as they may not be stored
+    this->_post_prob       = Matrix4D<T>(this->_n_seq,   this->_n_class+bg_class, this->_n_shift, this->_n_flip) ;
     this->_class_prob      = Matrix3D<double>(this->_n_class+bg_class, this->_n_shift, this->_n_flip) ;
     this->_class_prob_tot  = std::vector<double>(this->_n_class, 0.) ;
+    this->_log_likelihood_seq = std::vector<double>(this->_n_seq, 0.) ;
     this->_motifs          = std::vector<Matrix2D<double>>(this->_n_class, Matrix2D<double>(4,this->_l_motif)) ;
 
     // compute background from sequences
-    this->_bg_prob = dna::base_composition(this->_sequences, flip) ;
+    this->_bg_prob = dna::base_composition(*this->_sequences, flip) ;
 
     // add background class if needed (also increases this->_n_class)
     if(this->_bg_class)
     {   this->add_background_class() ; }
 
-    // seeds the random number generator BEFORE USING IT
+    // seeds the random number generator of this instance BEFORE USING IT
     if(seed != std::string(""))
-    {   getRandomGenerator(seed) ; }
+    {   std::seed_seq seed_sequence(seed.begin(), seed.end()) ;
+        this->_random_generator.seed(seed_sequence) ;
+    }
     else
-    {   getRandomGenerator() ; }
+    {   std::random_device rd ;
+        this->_random_generator.seed(rd()) ;
+    }
     // seeds
     this->seeding(seeding) ;
 }
 
-EMSequenceEngine::EMSequenceEngine(const Matrix2D<char>& sequences,
-                                   const std::vector<Matrix2D<double> >& motifs,
-                                   bool flip,
-                                   bool center_shift,
-                                   bool bg_class) throw (std::invalid_argument)
-    : _sequences(sequences), _motifs(motifs), _bg_prob({0.25, 0.25, 0.25, 0.25}), _n_iter(0),
-      _n_seq(_sequences.get_nrow()), _l_seq(_sequences.get_ncol()), _n_class(_motifs.size()),
+template<class T>
+EMSequenceEngine<T>::EMSequenceEngine(const Matrix2D<char>& sequences,
+                                      const std::vector<Matrix2D<double> >& motifs,
+                                      bool flip,
+                                      bool center_shift,
+                                      bool bg_class,
+                                      size_t n_threads) throw (std::invalid_argument)
+    : EMSequenceEngine(std::make_shared<PackedSequenceSet>(sequences),
+                       motifs, flip, center_shift, bg_class, n_threads)
+{}
+
+template<class T>
+EMSequenceEngine<T>::EMSequenceEngine(std::shared_ptr<const PackedSequenceSet> sequences,
+                                      const std::vector<Matrix2D<double> >& motifs,
+                                      bool flip,
+                                      bool center_shift,
+                                      bool bg_class,
+                                      size_t n_threads) throw (std::invalid_argument)
+    : _sequences(sequences), _motifs(motifs), _bg_prob({0.25, 0.25, 0.25, 0.25}), _post_prob_delta(0.),
+      _log_likelihood(0.), _log_likelihood_prev(0.), _n_iter(0), _n_iter_start(0),
+      _n_seq(_sequences->get_nseq()), _l_seq(_sequences->get_lseq()), _n_class(_motifs.size()),
       _l_motif(_motifs[0].get_ncol()), _n_shift(_l_seq-_l_motif+1), _n_flip(1+flip), _bg_class(bg_class),
-      _shift_center(center_shift)
+      _shift_center(center_shift), _n_threads(n_threads), _fused(false), _squarem(false), _squarem_step_max(1.),
+      _stopping_rule(Constants::stopping_rules::POST_PROB_DELTA), _tolerance(Constants::delta_max),
+      _sparse(false), _sparse_threshold(0.), _sparse_n_step(0), _sparse_full(false),
+      _shift_window(std::numeric_limits<size_t>::max()), _shift_threshold(0.),
+      _shift_from(0), _n_shift_band(_n_shift),
+      _incremental(false), _incremental_threshold(0.), _incremental_n_step(0), _incremental_full(false),
+      _hard(false)
 {
     // check the number of classes and the motif length
     if((this->_n_class == 0) or (this->_n_class > this->_n_seq) )
     {   throw std::invalid_argument("error! the number of classes should at least be 1, at most the number of sequences!") ; }
     else if((this->_l_motif == 0) or (this->_l_motif > this->_l_seq))
     {   throw std::invalid_argument("error! the motif length should be at least 1, at most the sequence length!") ; }
+    else if(this->_n_threads == 0)
+    {   throw std::invalid_argument("error! the number of threads should at least be 1!") ; }
 
     // check that all motifs have the same length
     for(auto& motif : this->_motifs)
@@ -85,14 +185,15 @@ EMSequenceEngine::EMSequenceEngine(const Matrix2D<char>& sequences,
         {   throw std::invalid_argument("error! the motifs should all have the same length!") ; }
     }
 
-    // init the data structures
-    this->_likelihood      = Matrix4D<double>(this->_n_seq,   this->_n_class+bg_class, this->_n_shift, this->_n_flip) ;
-    this->_post_prob       = Matrix4D<double>(this->_n_seq,   this->_n_class+bg_class, this->_n_shift, this->_n_flip) ;
+    // init the data structures, the likelihood are only allocated
+    // before the first EM step as they may not be stored
+    this->_post_prob       = Matrix4D<T>(this->_n_seq,   this->_n_class+bg_class, this->_n_shift, this->_n_flip) ;
     this->_class_prob      = Matrix3D<double>(this->_n_class+bg_class, this->_n_shift, this->_n_flip) ;
     this->_class_prob_tot  = std::vector<double>(this->_n_class, 0.) ;
+    this->_log_likelihood_seq = std::vector<double>(this->_n_seq, 0.) ;
 
     // compute background from sequences
-    this->_bg_prob = dna::base_composition(this->_sequences, flip) ;
+    this->_bg_prob = dna::base_composition(*this->_sequences, flip) ;
 
     // add background class if needed (also increases this->_n_class)
     if(this->_bg_class)
@@ -102,65 +203,51 @@ EMSequenceEngine::EMSequenceEngine(const Matrix2D<char>& sequences,
     // option 1) initialise as equally likely
     /*
     double p = 1. / static_cast<double>(this->_n_class*this->_n_shift*this->_n_flip) ;
-    this->_post_prob  = Matrix4D<double>(this->_n_seq,   this->_n_class, this->_n_shift, this->_n_flip, p) ;
+    this->_post_prob  = Matrix4D<T>(this->_n_seq,   this->_n_class, this->_n_shift, this->_n_flip, p) ;
     this->compute_class_prob() ;
     */
 
     // option 2) compute likelihood given the current model use this to set the initial
     // posterior probabilities
-
-    this->compute_likelihood() ;
-    for(size_t i=0; i<this->_n_seq; i++)
-    {   double sum = 0. ;
-        for(size_t k=0; k<this->_n_class; k++)
-        {   for(size_t s=0; s<this->_n_shift; s++)
-            {   for(size_t f=0; f<this->_n_flip; f++)
-                {   sum += this->_likelihood(i,k,s,f) ; }
-            }
-        }
-        for(size_t k=0; k<this->_n_class; k++)
-        {   for(size_t s=0; s<this->_n_shift; s++)
-            {   for(size_t f=0; f<this->_n_flip; f++)
-                {
-                    if(this->_likelihood(i,k,s,f) == 0.)
-                    {   this->_post_prob(i,k,s,f) = Constants::pseudo_counts ; }
-                    else
-                    {   this->_post_prob(i,k,s,f) = this->_likelihood(i,k,s,f)/sum ; }
-                }
-            }
-        }
-    }
-    this->compute_class_prob() ;
+    this->compute_initial_post_prob() ;
     // this->center_shifts() ;
 
 }
 
 
-EMSequenceEngine::~EMSequenceEngine()
+template<class T>
+EMSequenceEngine<T>::EMSequenceEngine(std::shared_ptr<const PackedSequenceSet> sequences,
+                                      const std::string& checkpoint,
+                                      size_t n_threads) throw (std::invalid_argument, std::runtime_error)
+    : _sequences(sequences), _bg_prob({0.25, 0.25, 0.25, 0.25}), _post_prob_delta(0.),
+      _log_likelihood(0.), _log_likelihood_prev(0.), _n_iter(0), _n_iter_start(0),
+      _n_seq(_sequences->get_nseq()), _l_seq(_sequences->get_lseq()), _n_class(0),
+      _l_motif(0), _n_shift(0), _n_flip(1), _bg_class(false),
+      _shift_center(false), _n_threads(n_threads), _fused(false), _squarem(false), _squarem_step_max(1.),
+      _stopping_rule(Constants::stopping_rules::POST_PROB_DELTA), _tolerance(Constants::delta_max),
+      _sparse(false), _sparse_threshold(0.), _sparse_n_step(0), _sparse_full(false),
+      _shift_window(std::numeric_limits<size_t>::max()), _shift_threshold(0.),
+      _shift_from(0), _n_shift_band(0),
+      _incremental(false), _incremental_threshold(0.), _incremental_n_step(0), _incremental_full(false),
+      _hard(false)
+{   if(this->_n_threads == 0)
+    {   throw std::invalid_argument("error! the number of threads should at least be 1!") ; }
+    this->read_checkpoint(checkpoint) ;
+}
+
+template<class T>
+EMSequenceEngine<T>::~EMSequenceEngine()
 {}
 
-Constants::clustering_codes EMSequenceEngine::cluster()
+template<class T>
+Constants::clustering_codes EMSequenceEngine<T>::cluster()
 {
-    // keep track of last iteration results
-    if(this->_n_iter > 0)
-    {   this->_post_prob_prev = this->_post_prob ; }
-
-    // E-step
-    this->compute_likelihood() ;
-    this->compute_posterior_prob() ;
-    this->compute_class_prob() ;
-
-    // this->print_alignment() ;
-
-    // M-step
-    this->compute_motifs() ;
-    this->normalise_motifs() ;
+    if(this->_squarem)
+    {   this->squarem_step() ; }
+    else
+    {   this->em_step() ; }
     this->_n_iter++ ;
 
-    // normalize the shifts
-    if(this->_shift_center)
-    {   this->center_shifts() ; }
-
     // the clustering cannot fail in the sense that
     // a class can never get a 0 probability (care is
     // taken that posterior prob. can never go to 0)
@@ -170,26 +257,583 @@ Constants::clustering_codes EMSequenceEngine::cluster()
     {   return Constants::clustering_codes::SUCCESS ; }
 }
 
-void EMSequenceEngine::seeding(const std::string &method) throw (std::runtime_error)
+template<class T>
+void EMSequenceEngine<T>::em_step()
+{
+    // E-step over the kept states, M-step over the same states
+    if(this->_sparse)
+    {   this->compute_posterior_prob_sparse() ;
+        this->compute_class_prob() ;
+        this->compute_motifs() ;
+    }
+    // E-step assigning each sequence to a state, M-step counting them
+    else if(this->_hard)
+    {   this->update_shift_band() ;
+        this->compute_assignment() ;
+        this->compute_class_prob() ;
+        this->compute_motifs() ;
+    }
+    // E-step over the active sequences, M-step from the cached statistics
+    else if(this->_incremental)
+    {   this->compute_em_incremental() ; }
+    // E-step and M-step in a single pass over the sequences
+    else if(this->_fused)
+    {   this->update_shift_band() ;
+        this->compute_em_fused() ;
+    }
+    else
+    {   this->update_shift_band() ;
+        this->allocate_likelihood() ;
+        // E-step
+        this->compute_likelihood() ;
+        this->compute_posterior_prob() ;
+        this->compute_class_prob() ;
+
+        // this->print_alignment() ;
+
+        // M-step
+        this->compute_motifs() ;
+    }
+    this->normalise_motifs() ;
+
+    // normalize the shifts
+    if(this->_shift_center)
+    {   this->center_shifts() ; }
+}
+
+template<class T>
+void EMSequenceEngine<T>::squarem_step()
+{   // two regular EM steps
+    std::vector<double> parameters_0 = this->get_parameters() ;
+    this->em_step() ;
+    std::vector<double> parameters_1 = this->get_parameters() ;
+    this->em_step() ;
+    std::vector<double> parameters_2 = this->get_parameters() ;
+    // the log likelihood of parameters_1, computed by the last E-step
+    double log_likelihood_1 = this->_log_likelihood ;
+
+    // the first and second differences
+    std::vector<double> r(parameters_0.size()) ;
+    std::vector<double> v(parameters_0.size()) ;
+    double r_norm = 0. ;
+    double v_norm = 0. ;
+    for(size_t i=0; i<parameters_0.size(); i++)
+    {   r[i]    = parameters_1[i] - parameters_0[i] ;
+        v[i]    = parameters_2[i] - parameters_1[i] - r[i] ;
+        r_norm += r[i]*r[i] ;
+        v_norm += v[i]*v[i] ;
+    }
+    // the steps are colinear, no extrapolation
+    if(v_norm == 0.)
+    {   return ; }
+
+    // the step length, within [-step_max, -1], -1 gives back parameters_2
+    double alpha = std::min(-std::sqrt(r_norm / v_norm), -1.) ;
+    alpha        = std::max(alpha, -this->_squarem_step_max) ;
+    std::vector<double> parameters(parameters_0.size()) ;
+    for(size_t i=0; i<parameters_0.size(); i++)
+    {   parameters[i] = parameters_0[i] - 2.*alpha*r[i] + alpha*alpha*v[i] ; }
+
+    // stabilization step from the extrapolated parameters
+    this->set_parameters(parameters) ;
+    this->em_step() ;
+
+    // safeguard, the extrapolation decreased the log likelihood, fall
+    // back to a regular EM step from parameters_2
+    if(this->_log_likelihood < log_likelihood_1)
+    {   this->set_parameters(parameters_2) ;
+        // such that the log likelihood change is measured against
+        // parameters_1 and not against the rejected parameters
+        this->_log_likelihood = log_likelihood_1 ;
+        this->em_step() ;
+        this->_squarem_step_max = std::max(1., this->_squarem_step_max / 4.) ;
+    }
+    // the step length was capped and accepted, allow longer steps
+    else if(alpha == -this->_squarem_step_max)
+    {   this->_squarem_step_max *= 4. ; }
+}
+
+template<class T>
+std::vector<double> EMSequenceEngine<T>::get_parameters() const
+{   size_t n_class = this->_n_class - this->_bg_class ;
+    std::vector<double> parameters ;
+    parameters.reserve(n_class*4*this->_l_motif + this->_n_class*this->_n_shift*this->_n_flip) ;
+    for(size_t k=0; k<n_class; k++)
+    {   for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<this->_l_motif; j++)
+            {   parameters.push_back(this->_motifs[k](i,j)) ; }
+        }
+    }
+    for(size_t k=0; k<this->_n_class; k++)
+    {   for(size_t s=0; s<this->_n_shift; s++)
+        {   for(size_t f=0; f<this->_n_flip; f++)
+            {   parameters.push_back(this->_class_prob(k,s,f)) ; }
+        }
+    }
+    return parameters ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_parameters(const std::vector<double>& parameters)
+{   size_t n_class = this->_n_class - this->_bg_class ;
+    size_t n = 0 ;
+    // motifs, the columns are normalized
+    for(size_t k=0; k<n_class; k++)
+    {   for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<this->_l_motif; j++, n++)
+            {   this->_motifs[k](i,j) = std::max(parameters[n], Constants::pseudo_counts) ; }
+        }
+        for(size_t j=0; j<this->_l_motif; j++)
+        {   double sum = 0. ;
+            for(size_t i=0; i<4; i++)
+            {   sum += this->_motifs[k](i,j) ; }
+            for(size_t i=0; i<4; i++)
+            {   this->_motifs[k](i,j) /= sum ; }
+        }
+    }
+    // class probabilities, normalized
+    Matrix3D<double> class_prob(this->_n_class, this->_n_shift, this->_n_flip) ;
+    for(size_t k=0; k<this->_n_class; k++)
+    {   for(size_t s=0; s<this->_n_shift; s++)
+        {   for(size_t f=0; f<this->_n_flip; f++, n++)
+            {   class_prob(k,s,f) = std::max(parameters[n], Constants::pseudo_counts) ; }
+        }
+    }
+    this->update_class_prob(class_prob) ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::seeding(const std::string &method) throw (std::runtime_error)
 {   if(method == "random")
     {   this->seeding_random() ; }
+    else if(method == "kmer")
+    {   this->seeding_kmer() ; }
     else
     {   throw std::runtime_error("unkown seeding") ; }
 }
 
-std::vector<Matrix2D<double>> EMSequenceEngine::get_motifs() const
+template<class T>
+void EMSequenceEngine<T>::set_fused(bool fused)
+{   if(fused == this->_fused)
+    {   return ; }
+    this->_fused = fused ;
+    // the likelihood are not stored in fused mode, otherwise they are
+    // allocated before the next E-step
+    if(fused)
+    {   this->_likelihood = Matrix4D<T>() ; }
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_acceleration(const std::string& method) throw (std::invalid_argument)
+{   if(method == "none")
+    {   this->_squarem = false ; }
+    else if(method == "squarem")
+    {   this->_squarem = true ; }
+    else
+    {   throw std::invalid_argument("error! unknown acceleration method!") ; }
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_sparse(double threshold) throw (std::invalid_argument)
+{   if(threshold < 0. or threshold >= 1.)
+    {   throw std::invalid_argument("error! the sparse threshold should be in [0,1)!") ; }
+    else if(threshold > 0. and this->_n_shift_band != this->_n_shift)
+    {   throw std::invalid_argument("error! the sparse mode cannot be used with a shift band!") ; }
+    else if(threshold > 0. and this->_incremental)
+    {   throw std::invalid_argument("error! the sparse mode cannot be used in incremental mode!") ; }
+    else if(threshold > 0. and this->_hard)
+    {   throw std::invalid_argument("error! the sparse mode cannot be used in hard mode!") ; }
+    this->_sparse_threshold = threshold ;
+    bool sparse = threshold > 0. ;
+    if(sparse == this->_sparse)
+    {   return ; }
+
+    this->_sparse_n_step = 0 ;
+    this->_sparse_full   = false ;
+    // the dense tensors are freed and the lists are left empty, the
+    // first E-step is a full rescoring which builds them
+    if(sparse)
+    {   this->_post_prob        = Matrix4D<T>() ;
+        this->_likelihood       = Matrix4D<T>() ;
+        this->_post_prob_sparse = std::vector<std::vector<std::pair<uint32_t,T>>>(this->_n_seq) ;
+        this->_sparse_log_mass  = std::vector<double>(this->_n_seq, 0.) ;
+    }
+    else
+    {   this->_post_prob = this->unpack_post_prob() ;
+        this->_post_prob_sparse.clear() ;
+        this->_sparse_log_mass.clear() ;
+    }
+    this->_sparse = sparse ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_shift_band(size_t window, double threshold) throw (std::invalid_argument)
+{   if(threshold < 0. or threshold >= 1.)
+    {   throw std::invalid_argument("error! the shift threshold should be in [0,1)!") ; }
+    else if(this->_sparse and (window < this->_n_shift or threshold > 0.))
+    {   throw std::invalid_argument("error! a shift band cannot be used in sparse mode!") ; }
+    this->_shift_window    = window ;
+    this->_shift_threshold = threshold ;
+    this->update_shift_band() ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_incremental(double threshold) throw (std::invalid_argument)
+{   if(threshold < 0. or threshold >= 1.)
+    {   throw std::invalid_argument("error! the incremental threshold should be in [0,1)!") ; }
+    else if(threshold > 0. and this->_sparse)
+    {   throw std::invalid_argument("error! the incremental mode cannot be used in sparse mode!") ; }
+    else if(threshold > 0. and this->_hard)
+    {   throw std::invalid_argument("error! the incremental mode cannot be used in hard mode!") ; }
+    this->_incremental           = threshold > 0. ;
+    this->_incremental_threshold = threshold ;
+    // the first E-step is a full sweep
+    this->_incremental_n_step    = 0 ;
+    this->_incremental_full      = false ;
+    this->_active_seq.clear() ;
+    // the likelihood are not stored in incremental mode
+    if(this->_incremental)
+    {   this->_likelihood          = Matrix4D<T>() ;
+        this->_post_prob_delta_seq = std::vector<double>(this->_n_seq, 0.) ;
+    }
+    else
+    {   this->_post_prob_delta_seq.clear() ;
+        this->_post_prob_sum_cache = Matrix3D<double>() ;
+        this->_motif_counts_cache.clear() ;
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_hard(bool hard) throw (std::invalid_argument)
+{   if(hard and (this->_sparse or this->_incremental))
+    {   throw std::invalid_argument("error! the hard mode cannot be used in sparse nor incremental mode!") ; }
+    else if(hard == this->_hard)
+    {   return ; }
+
+    // the initial assignments are the most likely states
+    if(hard)
+    {   this->_assignment = std::vector<uint32_t>(this->_n_seq, 0) ;
+        for(size_t i=0; i<this->_n_seq; i++)
+        {   T prob_max = this->_post_prob(i,0,0,0) ;
+            size_t k_max = 0, s_max = 0, f_max = 0 ;
+            for(size_t k=0; k<this->_n_class; k++)
+            {   for(size_t s=0; s<this->_n_shift_band; s++)
+                {   for(size_t f=0; f<this->_n_flip; f++)
+                    {   if(this->_post_prob(i,k,s,f) > prob_max)
+                        {   prob_max = this->_post_prob(i,k,s,f) ;
+                            k_max = k ; s_max = s ; f_max = f ;
+                        }
+                    }
+                }
+            }
+            this->_assignment[i] = (k_max*this->_n_shift + this->_shift_from + s_max)*this->_n_flip + f_max ;
+        }
+        this->_post_prob  = Matrix4D<T>() ;
+        this->_likelihood = Matrix4D<T>() ;
+        this->_hard       = true ;
+    }
+    else
+    {   this->_post_prob = this->unpack_assignment() ;
+        this->_assignment.clear() ;
+        this->_hard = false ;
+        // the full shift range, the band is set again at the next EM step
+        this->_shift_from   = 0 ;
+        this->_n_shift_band = this->_n_shift ;
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_stopping_rule(Constants::stopping_rules rule,
+                                            double tolerance) throw (std::invalid_argument)
+{   if(tolerance < 0.)
+    {   throw std::invalid_argument("error! the log likelihood tolerance should not be negative!") ; }
+    this->_stopping_rule = rule ;
+    this->_tolerance     = tolerance ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_sequences(const Matrix2D<char>& sequences) throw (std::invalid_argument)
+{   if(sequences.get_ncol() != this->_l_seq)
+    {   throw std::invalid_argument("error! the sequences should have the same length as the current ones!") ; }
+    else if(sequences.get_nrow() == 0)
+    {   throw std::invalid_argument("error! the sequences should contain at least 1 sequence!") ; }
+
+    this->_sequences = std::make_shared<PackedSequenceSet>(sequences) ;
+    this->_bg_log_prefix.reset() ;
+    this->_n_seq     = this->_sequences->get_nseq() ;
+
+    // the per sequence data structures
+    this->_likelihood         = Matrix4D<T>(this->_n_seq, this->_n_class, this->_n_shift_band, this->_n_flip) ;
+    this->_post_prob          = Matrix4D<T>(this->_n_seq, this->_n_class, this->_n_shift_band, this->_n_flip) ;
+    this->_log_likelihood_seq = std::vector<double>(this->_n_seq, 0.) ;
+    if(this->_bg_class)
+    {   this->compute_bg_likelihood() ; }
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_background_prob(const std::vector<double>& bg_prob) throw (std::invalid_argument)
+{   if(bg_prob.size() != 4)
+    {   throw std::invalid_argument("error! 4 background probabilities are expected!") ; }
+    this->_bg_prob = bg_prob ;
+    // the shared prefix sums were computed from other probabilities
+    this->_bg_log_prefix.reset() ;
+    // the background motif, the last one
+    if(this->_bg_class)
+    {   Matrix2D<double>& bg_motif = this->_motifs.back() ;
+        for(size_t i=0; i<bg_motif.get_nrow(); i++)
+        {   for(size_t j=0; j<bg_motif.get_ncol(); j++)
+            {   bg_motif(i,j) = this->_bg_prob[i] ; }
+        }
+        this->compute_bg_likelihood() ;
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_class_prob(const Matrix3D<double>& class_prob) throw (std::invalid_argument)
+{   std::vector<size_t> dim = class_prob.get_dim() ;
+    if(dim[0] != this->_n_class or dim[1] != this->_n_shift or dim[2] != this->_n_flip)
+    {   throw std::invalid_argument("error! the class probabilities dimensions do not match the model!") ; }
+    Matrix3D<double> class_prob_floor(class_prob) ;
+    for(size_t i=0; i<class_prob_floor.get_data_size(); i++)
+    {   class_prob_floor.set(i, std::max(class_prob_floor.get(i), Constants::pseudo_counts)) ; }
+    this->update_class_prob(class_prob_floor) ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::set_background_log_prefix(std::shared_ptr<const Matrix3D<double>> prefix) throw (std::invalid_argument)
+{   std::vector<size_t> dim = prefix->get_dim() ;
+    if(dim[0] != this->_n_seq or dim[1] != this->_l_seq+1 or dim[2] < this->_n_flip)
+    {   throw std::invalid_argument("error! the background prefix sums do not match the sequences!") ; }
+    this->_bg_log_prefix = prefix ;
+    // the background class likelihoods were computed by the constructor
+    if(this->_bg_class)
+    {   this->compute_bg_likelihood() ; }
+}
+
+template<class T>
+void EMSequenceEngine<T>::cluster_batch(double step_size) throw (std::invalid_argument)
+{   if(step_size <= 0. or step_size > 1.)
+    {   throw std::invalid_argument("error! the step size should be in (0,1]!") ; }
+
+    // E-step
+    this->compute_likelihood() ;
+    this->compute_posterior_prob() ;
+
+    // the sufficient statistics of the batch, per sequence
+    Matrix3D<double> post_prob_sum = this->compute_post_prob_sum() ;
+    std::vector<Matrix2D<double>> counts = this->compute_motif_counts() ;
+    double n_seq = static_cast<double>(this->_n_seq) ;
+
+    // blended into the running statistics, a step size of 1 discards them
+    if(step_size == 1.)
+    {   this->_post_prob_sum_stat = Matrix3D<double>(this->_n_class, this->_n_shift, this->_n_flip, 0.) ;
+        this->_motif_counts_stat  = std::vector<Matrix2D<double>>(counts.size(), Matrix2D<double>(4, this->_l_motif, 0.)) ;
+    }
+    for(size_t k=0; k<this->_n_class; k++)
+    {   for(size_t s=0; s<this->_n_shift; s++)
+        {   for(size_t f=0; f<this->_n_flip; f++)
+            {   this->_post_prob_sum_stat(k,s,f) = (1. - step_size) * this->_post_prob_sum_stat(k,s,f) +
+                                                   step_size * post_prob_sum(k,s,f) / n_seq ;
+            }
+        }
+    }
+    for(size_t k=0; k<counts.size(); k++)
+    {   for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<this->_l_motif; j++)
+            {   this->_motif_counts_stat[k](i,j) = (1. - step_size) * this->_motif_counts_stat[k](i,j) +
+                                                   step_size * counts[k](i,j) / n_seq ;
+            }
+        }
+    }
+
+    // M-step from the running statistics
+    this->update_class_prob(this->_post_prob_sum_stat) ;
+    this->update_motifs(this->_motif_counts_stat) ;
+    this->normalise_motifs() ;
+    if(this->_shift_center)
+    {   this->center_shifts() ; }
+}
+
+template<class T>
+void EMSequenceEngine<T>::update_post_prob()
+{   this->compute_likelihood() ;
+    this->compute_posterior_prob() ;
+}
+
+template<class T>
+std::vector<Matrix2D<double>> EMSequenceEngine<T>::get_motifs() const
 {   return this->_motifs ; }
 
-Matrix4D<double> EMSequenceEngine::get_post_prob() const
-{   return this->_post_prob ; }
+template<class T>
+Matrix4D<T> EMSequenceEngine<T>::get_post_prob() const
+{   if(this->_sparse)
+    {   return this->unpack_post_prob() ; }
+    else if(this->_hard)
+    {   return this->unpack_assignment() ; }
+    else if(this->_n_shift_band == this->_n_shift)
+    {   return this->_post_prob ; }
+    // the shifts outside the band are set to pseudo counts
+    Matrix4D<T> post_prob(this->_n_seq, this->_n_class, this->_n_shift, this->_n_flip, Constants::pseudo_counts) ;
+    for(size_t i=0; i<this->_n_seq; i++)
+    {   for(size_t k=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++)
+                {   post_prob(i,k,this->_shift_from+s,f) = this->_post_prob(i,k,s,f) ; }
+            }
+        }
+    }
+    return post_prob ;
+}
 
-Matrix3D<double> EMSequenceEngine::get_class_prob() const
+template<class T>
+Matrix3D<double> EMSequenceEngine<T>::get_class_prob() const
 {   return this->_class_prob ; }
 
-std::vector<double> EMSequenceEngine::get_class_prob_total() const
+template<class T>
+std::vector<double> EMSequenceEngine<T>::get_class_prob_total() const
 {   return this->_class_prob_tot ; }
 
-void EMSequenceEngine::print_results(std::ostream& stream) const
+template<class T>
+double EMSequenceEngine<T>::get_log_likelihood() const
+{   return this->_log_likelihood ; }
+
+template<class T>
+double EMSequenceEngine<T>::get_post_prob_delta() const
+{   return this->_post_prob_delta ; }
+
+template<class T>
+double EMSequenceEngine<T>::compute_sequence_log_likelihood() const
+{   std::vector<double> motifs_log = this->compute_motifs_log() ;
+    Matrix3D<double> class_prob_log = this->compute_class_prob_log() ;
+
+    // the partial sums are added in slice order, the result does not
+    // depend on the order in which the slices are processed
+    std::vector<double> partials(this->get_slice_number(), 0.) ;
+    this->run_on_slices([this, &motifs_log, &class_prob_log, &partials](size_t slice, size_t from, size_t to)
+                        {   partials[slice] = this->compute_sequence_log_likelihood_routine(from, to,
+                                                                                            motifs_log,
+                                                                                            class_prob_log) ;
+                        }) ;
+    return std::accumulate(partials.begin(), partials.end(), 0.) ;
+}
+
+template<class T>
+double EMSequenceEngine<T>::compute_sequence_log_likelihood_routine(size_t from, size_t to,
+                                                                    const std::vector<double>& motifs_log,
+                                                                    const Matrix3D<double>& class_prob_log) const
+{   size_t n_class = this->_n_class - this->_bg_class ;
+    size_t n_motif = n_class*this->_n_flip ;
+    std::vector<int32_t> sequence ;
+    // the scores of all trained classes and flip states, flat
+    // [shift][class][flip] array
+    std::vector<double> scores ;
+    std::vector<double> prefix(this->_l_seq+1, 0.) ;
+    std::vector<double> prefix_rev(this->_l_seq+1, 0.) ;
+    // the log joint probability of the sequence and each state, flat
+    // [class][shift][flip] array
+    std::vector<double> log_prob(this->_n_class*this->_n_shift*this->_n_flip) ;
+    double log_likelihood = 0. ;
+
+    for(size_t i=from; i<to; i++)
+    {   this->_sequences->decode(i, sequence) ;
+        dna::score_all_shifts_all_motifs(sequence, motifs_log, n_motif, scores) ;
+        this->get_bg_log_prefix(i, prefix, prefix_rev) ;
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   const std::vector<double>& p = f == Constants::FORWARD ? prefix : prefix_rev ;
+                    // the whole sequence is background for the background class,
+                    // the bases outside the sub-sequence for the other classes
+                    double bg_outside = p[this->_l_seq] - (p[s+this->_l_motif] - p[s]) ;
+                    log_prob[n] = class_prob_log(k,s,f) +
+                                  (k == n_class ? p[this->_l_seq] :
+                                                  scores[(s*n_class + k)*this->_n_flip + f] + bg_outside) ;
+                }
+            }
+        }
+        log_likelihood += log_normalize(log_prob) ;
+    }
+    return log_likelihood ;
+}
+
+template<class T>
+size_t EMSequenceEngine<T>::get_n_iter() const
+{   return this->_n_iter ; }
+
+template<class T>
+void EMSequenceEngine<T>::write_checkpoint(const std::string& checkpoint) const throw (std::runtime_error)
+{   std::string file_tmp = checkpoint + ".tmp" ;
+    std::ofstream stream(file_tmp, std::ios::out | std::ios::binary | std::ios::trunc) ;
+    if(stream.fail())
+    {   char msg[1024] ;
+        sprintf(msg, "error! cannot write checkpoint %s", file_tmp.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+
+    // header
+    stream.write(checkpoint_magic, sizeof(checkpoint_magic)) ;
+    write_binary<uint32_t>(stream, checkpoint_version) ;
+    write_binary<uint32_t>(stream, sizeof(T)) ;
+
+    // model dimensions, checked against the sequences when resuming
+    write_binary<uint64_t>(stream, this->_n_seq) ;
+    write_binary<uint64_t>(stream, this->_l_seq) ;
+    write_binary<uint64_t>(stream, this->_n_class) ;
+    write_binary<uint64_t>(stream, this->_l_motif) ;
+    write_binary<uint64_t>(stream, this->_n_flip) ;
+    write_binary<uint8_t>(stream, this->_bg_class) ;
+    write_binary<uint8_t>(stream, this->_shift_center) ;
+
+    // settings
+    write_binary<uint8_t>(stream, this->_fused) ;
+    write_binary<uint8_t>(stream, this->_squarem) ;
+    write_binary<double>(stream, this->_squarem_step_max) ;
+    write_binary<uint32_t>(stream, this->_stopping_rule) ;
+    write_binary<double>(stream, this->_tolerance) ;
+    write_binary<double>(stream, this->_sparse_threshold) ;
+    write_binary<uint64_t>(stream, this->_sparse_n_step) ;
+    write_binary<uint64_t>(stream, this->_shift_window) ;
+    write_binary<double>(stream, this->_shift_threshold) ;
+    write_binary<double>(stream, this->_incremental_threshold) ;
+    write_binary<uint8_t>(stream, this->_hard) ;
+
+    // model
+    write_binary<uint64_t>(stream, this->_n_iter) ;
+    write_binary<double>(stream, this->_log_likelihood) ;
+    write_binary<double>(stream, this->_log_likelihood_prev) ;
+    for(size_t b=0; b<4; b++)
+    {   write_binary<double>(stream, this->_bg_prob[b]) ; }
+    for(size_t k=0; k<this->_n_class; k++)
+    {   for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<this->_l_motif; j++)
+            {   write_binary<double>(stream, this->_motifs[k](i,j)) ; }
+        }
+    }
+    for(size_t k=0; k<this->_n_class; k++)
+    {   write_binary<double>(stream, this->_class_prob_tot[k]) ;
+        for(size_t s=0; s<this->_n_shift; s++)
+        {   for(size_t f=0; f<this->_n_flip; f++)
+            {   write_binary<double>(stream, this->_class_prob(k,s,f)) ; }
+        }
+    }
+
+    // random number generator, in its portable text form
+    std::ostringstream generator ;
+    generator << this->_random_generator ;
+    std::string generator_str = generator.str() ;
+    write_binary<uint64_t>(stream, generator_str.size()) ;
+    stream.write(generator_str.data(), generator_str.size()) ;
+
+    stream.close() ;
+    if(stream.fail() or std::rename(file_tmp.c_str(), checkpoint.c_str()) != 0)
+    {   char msg[1024] ;
+        sprintf(msg, "error! cannot write checkpoint %s", checkpoint.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::print_results(std::ostream& stream) const
 {
 
     for(const auto& motif : this->_motifs)
@@ -199,25 +843,160 @@ void EMSequenceEngine::print_results(std::ostream& stream) const
     // stream << this->_likelihood << std::endl << std::endl ;
 }
 
-bool EMSequenceEngine::hasConverged() const
+template<class T>
+bool EMSequenceEngine<T>::hasConverged() const
 {   bool convergence = true ;
 
     // there were no previous value, cannot check for convergence
-    if(this->_n_iter == 1)
+    if(this->_n_iter == this->_n_iter_start+1)
+    {   convergence = false ; }
+    // the frozen sequences were not checked
+    else if(this->_incremental and (not this->_incremental_full))
+    {   convergence = false ; }
+    // the pruned states were not checked
+    else if(this->_sparse and (not this->_sparse_full))
     {   convergence = false ; }
-    // let's check the probs
     else
-    {   for(size_t i=0; i<this->_post_prob.get_data_size(); i++)
-        {   if(std::abs(this->_post_prob.get({i}) - this->_post_prob_prev.get({i})) > Constants::delta_max)
-            {   convergence = false ;
+    {   // let's check the probs, the largest change is tracked by the E-step
+        bool post_prob_stable = this->_post_prob_delta <= Constants::delta_max ;
+        // let's check the relative log likelihood change
+        bool likelihood_stable = std::abs(this->_log_likelihood - this->_log_likelihood_prev) <=
+                                 this->_tolerance * std::abs(this->_log_likelihood_prev) ;
+        switch(this->_stopping_rule)
+        {   case Constants::stopping_rules::LOG_LIKELIHOOD:
+                convergence = likelihood_stable ;
+                break ;
+            case Constants::stopping_rules::BOTH:
+                convergence = post_prob_stable and likelihood_stable ;
+                break ;
+            default:
+                convergence = post_prob_stable ;
                 break ;
-            }
         }
     }
     return convergence ;
 }
 
-void EMSequenceEngine::add_background_class()
+template<class T>
+void EMSequenceEngine<T>::read_checkpoint(const std::string& checkpoint) throw (std::invalid_argument, std::runtime_error)
+{   std::ifstream stream(checkpoint, std::ios::in | std::ios::binary) ;
+    char msg[1024] ;
+    if(stream.fail())
+    {   sprintf(msg, "error! cannot open checkpoint %s", checkpoint.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+
+    // header
+    char magic[sizeof(checkpoint_magic)] ;
+    stream.read(magic, sizeof(magic)) ;
+    if(stream.fail() or std::memcmp(magic, checkpoint_magic, sizeof(magic)) != 0 or
+       read_binary<uint32_t>(stream) != checkpoint_version)
+    {   sprintf(msg, "error! %s is not a valid checkpoint!", checkpoint.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+    if(read_binary<uint32_t>(stream) != sizeof(T))
+    {   throw std::invalid_argument("error! the checkpoint was written using another precision!") ; }
+
+    // model dimensions
+    size_t n_seq        = read_binary<uint64_t>(stream) ;
+    size_t l_seq        = read_binary<uint64_t>(stream) ;
+    this->_n_class      = read_binary<uint64_t>(stream) ;
+    this->_l_motif      = read_binary<uint64_t>(stream) ;
+    this->_n_flip       = read_binary<uint64_t>(stream) ;
+    this->_bg_class     = read_binary<uint8_t>(stream) ;
+    this->_shift_center = read_binary<uint8_t>(stream) ;
+    if(stream.fail())
+    {   sprintf(msg, "error! %s is not a valid checkpoint!", checkpoint.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+    else if(n_seq != this->_n_seq or l_seq != this->_l_seq)
+    {   throw std::invalid_argument("error! the checkpoint was written for other sequences!") ; }
+    else if(this->_n_class == 0 or this->_l_motif == 0 or this->_l_motif > this->_l_seq or
+            this->_n_flip == 0 or this->_n_flip > 2)
+    {   sprintf(msg, "error! %s is not a valid checkpoint!", checkpoint.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+    this->_n_shift      = this->_l_seq - this->_l_motif + 1 ;
+    this->_n_shift_band = this->_n_shift ;
+
+    // settings, applied once the data structures are allocated
+    bool fused                   = read_binary<uint8_t>(stream) ;
+    this->_squarem               = read_binary<uint8_t>(stream) ;
+    double squarem_step_max      = read_binary<double>(stream) ;
+    uint32_t stopping_rule       = read_binary<uint32_t>(stream) ;
+    double tolerance             = read_binary<double>(stream) ;
+    double sparse_threshold      = read_binary<double>(stream) ;
+    size_t sparse_n_step         = read_binary<uint64_t>(stream) ;
+    size_t shift_window          = read_binary<uint64_t>(stream) ;
+    double shift_threshold       = read_binary<double>(stream) ;
+    double incremental_threshold = read_binary<double>(stream) ;
+    bool hard                    = read_binary<uint8_t>(stream) ;
+
+    // model
+    this->_n_iter              = read_binary<uint64_t>(stream) ;
+    this->_n_iter_start        = this->_n_iter ;
+    this->_log_likelihood      = read_binary<double>(stream) ;
+    this->_log_likelihood_prev = read_binary<double>(stream) ;
+    for(size_t b=0; b<4; b++)
+    {   this->_bg_prob[b] = read_binary<double>(stream) ; }
+    this->_motifs = std::vector<Matrix2D<double>>(this->_n_class, Matrix2D<double>(4, this->_l_motif)) ;
+    for(size_t k=0; k<this->_n_class; k++)
+    {   for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<this->_l_motif; j++)
+            {   this->_motifs[k](i,j) = read_binary<double>(stream) ; }
+        }
+    }
+    this->_class_prob     = Matrix3D<double>(this->_n_class, this->_n_shift, this->_n_flip) ;
+    this->_class_prob_tot = std::vector<double>(this->_n_class, 0.) ;
+    for(size_t k=0; k<this->_n_class; k++)
+    {   this->_class_prob_tot[k] = read_binary<double>(stream) ;
+        for(size_t s=0; s<this->_n_shift; s++)
+        {   for(size_t f=0; f<this->_n_flip; f++)
+            {   this->_class_prob(k,s,f) = read_binary<double>(stream) ; }
+        }
+    }
+
+    // random number generator
+    std::string generator_str(read_binary<uint64_t>(stream), '\0') ;
+    stream.read(&generator_str[0], generator_str.size()) ;
+    std::istringstream generator(generator_str) ;
+    generator >> this->_random_generator ;
+    if(stream.fail() or generator.fail() or stopping_rule >= Constants::stopping_rules::N_RULES)
+    {   sprintf(msg, "error! %s is not a valid checkpoint!", checkpoint.c_str()) ;
+        throw std::runtime_error(msg) ;
+    }
+
+    // init the data structures, the posterior probabilities are
+    // only used to measure their change during the next E-step
+    double p = 1. / static_cast<double>(this->_n_class*this->_n_shift*this->_n_flip) ;
+    this->_post_prob          = Matrix4D<T>(this->_n_seq, this->_n_class, this->_n_shift, this->_n_flip, p) ;
+    this->_log_likelihood_seq = std::vector<double>(this->_n_seq, 0.) ;
+    if(this->_bg_class)
+    {   this->compute_bg_likelihood() ; }
+
+    // settings, in the order in which they can be combined
+    this->set_fused(fused) ;
+    this->set_sparse(sparse_threshold) ;
+    this->set_shift_band(shift_window, shift_threshold) ;
+    this->set_incremental(incremental_threshold) ;
+    this->set_hard(hard) ;
+    this->set_stopping_rule(static_cast<Constants::stopping_rules>(stopping_rule), tolerance) ;
+    this->_squarem_step_max = squarem_step_max ;
+    // the full rescorings follow the same schedule, all the states are
+    // kept until the next one
+    this->_sparse_n_step    = sparse_n_step ;
+    if(this->_sparse and (this->_sparse_n_step % Constants::sparse_period != 0))
+    {   size_t n_state = this->_n_class*this->_n_shift*this->_n_flip ;
+        for(auto& states : this->_post_prob_sparse)
+        {   states.reserve(n_state) ;
+            for(size_t n=0; n<n_state; n++)
+            {   states.emplace_back(n, p) ; }
+        }
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::add_background_class()
 {   Matrix2D<double> bg_motif(4, this->_l_motif) ;
     for(size_t i=0; i<bg_motif.get_nrow(); i++)
     {   for(size_t j=0; j<bg_motif.get_ncol(); j++)
@@ -225,13 +1004,73 @@ void EMSequenceEngine::add_background_class()
     }
     this->_motifs.push_back(bg_motif) ;
     this->_n_class++ ;
+    // the background motif is never updated
+    this->compute_bg_likelihood() ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_bg_likelihood()
+{   this->_bg_likelihood = Matrix3D<T>(this->_n_seq, this->_n_shift, this->_n_flip) ;
+    // prefix sums of the log background probabilities of the bases and
+    // of their complement, the log likelihood of a window is the
+    // difference of two prefix sums
+    std::vector<double> prefix(this->_l_seq+1, 0.) ;
+    std::vector<double> prefix_rev(this->_l_seq+1, 0.) ;
+    for(size_t i=0; i<this->_n_seq; i++)
+    {   this->get_bg_log_prefix(i, prefix, prefix_rev) ;
+        for(size_t s=0; s<this->_n_shift; s++)
+        {   // forward strand
+            {   this->_bg_likelihood(i,s,Constants::FORWARD) = prefix[s+this->_l_motif] - prefix[s] ; }
+            // reverse strand
+            if(this->_n_flip == 2)
+            {   this->_bg_likelihood(i,s,Constants::REVERSE) = prefix_rev[s+this->_l_motif] - prefix_rev[s] ; }
+        }
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::allocate_likelihood()
+{   std::vector<size_t> dim = {this->_n_seq, this->_n_class, this->_n_shift_band, this->_n_flip} ;
+    if(this->_likelihood.get_dim() != dim)
+    {   // freed first, such that both matrices never coexist
+        this->_likelihood = Matrix4D<T>() ;
+        this->_likelihood = Matrix4D<T>(this->_n_seq, this->_n_class, this->_n_shift_band, this->_n_flip) ;
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::get_bg_log_prefix(size_t seq_index,
+                                            std::vector<double>& prefix,
+                                            std::vector<double>& prefix_rev) const
+{   // shared table
+    if(this->_bg_log_prefix)
+    {   for(size_t j=0; j<=this->_l_seq; j++)
+        {   prefix[j] = (*this->_bg_log_prefix)(seq_index,j,Constants::FORWARD) ;
+            if(this->_n_flip == 2)
+            {   prefix_rev[j] = (*this->_bg_log_prefix)(seq_index,j,Constants::REVERSE) ; }
+        }
+        return ;
+    }
+
+    double bg_log[4] ;
+    for(size_t b=0; b<4; b++)
+    {   bg_log[b] = log(this->_bg_prob[b]) ; }
+    const PackedSequenceSet& sequences = *this->_sequences ;
+    prefix[0]     = 0. ;
+    prefix_rev[0] = 0. ;
+    for(size_t j=0; j<this->_l_seq; j++)
+    {   size_t base = sequences(seq_index,j) ;
+        prefix[j+1]     = prefix[j]     + bg_log[base] ;
+        prefix_rev[j+1] = prefix_rev[j] + bg_log[3-base] ;
+    }
 }
 
-void EMSequenceEngine::seeding_random()
+template<class T>
+void EMSequenceEngine<T>::seeding_random()
 {   // random sampling
     beta_distribution<> beta(1, this->_n_seq) ;
     for(size_t i=0; i<this->_post_prob.get_data_size(); i++)
-    {   this->_post_prob.set(i, beta(getRandomGenerator())) ; }
+    {   this->_post_prob.set(i, beta(this->_random_generator)) ; }
 
     // normalization
     for(size_t i=0; i<this->_n_seq; i++)
@@ -257,7 +1096,122 @@ void EMSequenceEngine::seeding_random()
     this->compute_motifs() ;
 }
 
-void EMSequenceEngine::center_shifts()
+template<class T>
+void EMSequenceEngine<T>::seeding_kmer()
+{   size_t k        = std::min(this->_l_motif, Constants::kmer_length) ;
+    size_t n_kmer   = static_cast<size_t>(1) << (2*k) ;
+    size_t n_class  = this->_n_class - this->_bg_class ;
+    bool   flip     = this->_n_flip == Constants::flip::N_FLIP_STATES ;
+
+    // each slice of sequences counts its own k-mers
+    std::vector<std::vector<uint64_t>> partials(this->get_slice_number(),
+                                                std::vector<uint64_t>(n_kmer, 0)) ;
+    this->run_on_slices([this, k, flip, &partials](size_t slice, size_t from, size_t to)
+                        {   dna::count_kmers(*this->_sequences, k, flip, from, to, partials[slice]) ; }) ;
+    tree_reduce(partials, [](std::vector<uint64_t>& lhs, const std::vector<uint64_t>& rhs)
+                          {   for(size_t i=0; i<lhs.size(); i++)
+                              {   lhs[i] += rhs[i] ; }
+                          }) ;
+    const std::vector<uint64_t>& counts = partials[0] ;
+
+    // z-score of each k-mer given the background model
+    double n_pos = static_cast<double>(this->_n_seq * (this->_l_seq-k+1) * this->_n_flip) ;
+    std::vector<double> z_scores(n_kmer) ;
+    for(size_t code=0; code<n_kmer; code++)
+    {   double expected = n_pos ;
+        for(size_t j=0; j<k; j++)
+        {   expected *= this->_bg_prob[(code >> (2*j)) & 3] ; }
+        expected = std::max(expected, Constants::pseudo_counts) ;
+        z_scores[code] = (static_cast<double>(counts[code]) - expected) / std::sqrt(expected) ;
+    }
+    std::vector<size_t> ranking(n_kmer) ;
+    std::iota(ranking.begin(), ranking.end(), 0) ;
+    std::stable_sort(ranking.begin(), ranking.end(),
+                     [&z_scores](size_t a, size_t b) { return z_scores[a] > z_scores[b] ; }) ;
+
+    // greedy pick of the best dissimilar k-mers, completed with the next
+    // best ones if there are not enough
+    std::vector<uint64_t> picked ;
+    for(size_t r=0; r<n_kmer and picked.size()<n_class; r++)
+    {   uint64_t code = ranking[r] ;
+        bool similar  = false ;
+        for(size_t p=0; p<picked.size() and not similar; p++)
+        {   similar = kmers_similar(code, picked[p], k) or
+                      (flip and kmers_similar(code, dna::kmer_reverse_complement(picked[p], k), k)) ;
+        }
+        if(not similar)
+        {   picked.push_back(code) ; }
+    }
+    for(size_t r=0; r<n_kmer and picked.size()<n_class; r++)
+    {   if(std::find(picked.begin(), picked.end(), ranking[r]) == picked.end())
+        {   picked.push_back(ranking[r]) ; }
+    }
+
+    // the motifs, the background model with the centered k-mer
+    size_t offset = (this->_l_motif - k) / 2 ;
+    for(size_t m=0; m<n_class; m++)
+    {   Matrix2D<double>& motif = this->_motifs[m] ;
+        for(size_t j=0; j<this->_l_motif; j++)
+        {   for(size_t i=0; i<4; i++)
+            {   motif(i,j) = this->_bg_prob[i] ; }
+        }
+        for(size_t j=0; j<k; j++)
+        {   size_t base = (picked[m] >> (2*(k-1-j))) & 3 ;
+            for(size_t i=0; i<4; i++)
+            {   motif(i,offset+j) = (1.-Constants::kmer_weight) * this->_bg_prob[i] +
+                                    Constants::kmer_weight * (i == base) ;
+            }
+        }
+    }
+
+    this->compute_initial_post_prob() ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_initial_post_prob()
+{   std::vector<double> motifs_log = this->compute_motifs_log() ;
+    this->run_on_chunks([this, &motifs_log](size_t from, size_t to)
+                        {   this->compute_initial_post_prob_routine(from, to, motifs_log) ; }) ;
+    this->compute_class_prob() ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_initial_post_prob_routine(size_t from, size_t to,
+                                                            const std::vector<double>& motifs_log)
+{   size_t n_class = this->_n_class - this->_bg_class ;
+    size_t n_motif = n_class*this->_n_flip ;
+    std::vector<int32_t> sequence ;
+    // the scores of all trained classes and flip states, flat
+    // [shift][class][flip] array
+    std::vector<double> scores ;
+    std::vector<double> post_prob(this->_n_class*this->_n_shift*this->_n_flip) ;
+    for(size_t i=from; i<to; i++)
+    {   this->_sequences->decode(i, sequence) ;
+        dna::score_all_shifts_all_motifs(sequence, motifs_log, n_motif, scores) ;
+        // the likelihood are rounded to the storage precision, as if
+        // they were stored
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   // background class, computed once
+                    post_prob[n] = k == n_class ?
+                                   static_cast<T>(this->_bg_likelihood(i,s,f)) :
+                                   static_cast<T>(scores[(s*n_class + k)*this->_n_flip + f]) ;
+                }
+            }
+        }
+        log_normalize(post_prob) ;
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   this->_post_prob(i,k,s,f) = this->to_post_prob(post_prob[n]) ; }
+            }
+        }
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::center_shifts()
 {
     if(this->_n_shift == 1)
     {   return ; }
@@ -315,7 +1269,84 @@ void EMSequenceEngine::center_shifts()
     }
 }
 
-void EMSequenceEngine::compute_class_prob()
+template<class T>
+void EMSequenceEngine<T>::compute_class_prob()
+{   this->update_class_prob(this->compute_post_prob_sum()) ; }
+
+template<class T>
+Matrix3D<double> EMSequenceEngine<T>::compute_post_prob_sum() const
+{   // each slice of sequences sums its own posterior prob
+    std::vector<Matrix3D<double>> partials(this->get_slice_number(),
+                                           Matrix3D<double>(this->_n_class, this->_n_shift, this->_n_flip, 0.)) ;
+    this->run_on_slices([this, &partials](size_t slice, size_t from, size_t to)
+                        {   if(this->_sparse)
+                            {   this->compute_class_prob_sparse_routine(from, to, partials[slice]) ; }
+                            else if(this->_hard)
+                            {   this->compute_class_prob_hard_routine(from, to, partials[slice]) ; }
+                            else
+                            {   this->compute_class_prob_routine(from, to, partials[slice]) ; }
+                        }) ;
+    this->reduce_class_prob(partials) ;
+    return partials[0] ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_class_prob_routine(size_t from, size_t to,
+                                                     Matrix3D<double>& class_prob) const
+{   // the posterior prob of consecutive sequences are contiguous for
+    // a given shift and flip state
+    for(size_t f=0; f<this->_n_flip; f++)
+    {   for(size_t s=0; s<this->_n_shift_band; s++)
+        {   for(size_t i=from; i<to; i++)
+            {   for(size_t k=0; k<this->_n_class; k++)
+                {   class_prob(k,this->_shift_from+s,f) += this->_post_prob(i,k,s,f) ; }
+            }
+        }
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_class_prob_sparse_routine(size_t from, size_t to,
+                                                            Matrix3D<double>& class_prob) const
+{   size_t k, s, f ;
+    for(size_t i=from; i<to; i++)
+    {   for(const auto& state : this->_post_prob_sparse[i])
+        {   this->decode_state(state.first, k, s, f) ;
+            class_prob(k,s,f) += state.second ;
+        }
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_class_prob_hard_routine(size_t from, size_t to,
+                                                          Matrix3D<double>& class_prob) const
+{   // the number of sequences assigned to each state
+    std::vector<uint64_t> counts(this->_n_class*this->_n_shift*this->_n_flip, 0) ;
+    for(size_t i=from; i<to; i++)
+    {   counts[this->_assignment[i]]++ ; }
+    // the other states have pseudo counts
+    double pseudo_counts = (to - from) * Constants::pseudo_counts ;
+    size_t k, s, f ;
+    for(size_t n=0; n<counts.size(); n++)
+    {   this->decode_state(n, k, s, f) ;
+        class_prob(k,s,f) += static_cast<double>(counts[n]) + pseudo_counts ;
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::reduce_class_prob(std::vector<Matrix3D<double>>& partials) const
+{   tree_reduce(partials, [this](Matrix3D<double>& lhs, const Matrix3D<double>& rhs)
+                          {   for(size_t k=0; k<this->_n_class; k++)
+                              {   for(size_t s=0; s<this->_n_shift; s++)
+                                  {   for(size_t f=0; f<this->_n_flip; f++)
+                                      {   lhs(k,s,f) += rhs(k,s,f) ; }
+                                  }
+                              }
+                          }) ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::update_class_prob(const Matrix3D<double>& post_prob_sum)
 {
     // reset
     this->_class_prob_tot = std::vector<double>(this->_n_class, 0.) ;
@@ -325,9 +1356,7 @@ void EMSequenceEngine::compute_class_prob()
     for(size_t k=0; k<this->_n_class; k++)
     {   for(size_t s=0; s<this->_n_shift; s++)
         {   for(size_t f=0; f<this->_n_flip; f++)
-             {  double prob = 0. ;
-                for(size_t i=0; i<this->_n_seq; i++)
-                {   prob += this->_post_prob(i,k,s,f) ; }
+             {  double prob = post_prob_sum(k,s,f) ;
                 prob_tot += prob ;
                 this->_class_prob(k,s,f) = prob ;
                 this->_class_prob_tot[k] += prob ;
@@ -351,53 +1380,159 @@ void EMSequenceEngine::compute_class_prob()
     // std::cerr << this->_class_prob << std::endl << std::endl ;
 }
 
-void EMSequenceEngine::compute_motifs()
+template<class T>
+void EMSequenceEngine<T>::compute_motifs()
 {
     // int corr = this->debug() ;
 
-    // if there is a background class, don't touch it, leave it untrained
-    size_t n_class = this->_n_class - this->_bg_class ;
+    this->update_motifs(this->compute_motif_counts()) ;
+}
 
-    // reset motifs
-    for(size_t i=0; i<4; i++)
-    {   for(size_t j=0; j<this->_l_motif; j++)
-        {   for(size_t k=0; k<n_class; k++)
-            {   this->_motifs[k](i,j) = 0. ; }
-        }
-    }
+template<class T>
+std::vector<Matrix2D<double>> EMSequenceEngine<T>::compute_motif_counts() const
+{   // if there is a background class, don't touch it, leave it untrained
+    size_t n_class = this->_n_class - this->_bg_class ;
 
-    // recompute them
-    for(size_t k=0; k<n_class; k++)
-    {   for(size_t s=0; s<this->_n_shift; s++)
-        {   for(size_t j=0; j<this->_l_motif; j++)
-            {   std::vector<double> base_prob(4,0.) ;     // base prob on forward strand
-                std::vector<double> base_prob_rev(4,0.) ; // base prob on reverse strand
+    // each slice of sequences computes its own base counts
+    std::vector<std::vector<Matrix2D<double>>> partials(this->get_slice_number(),
+                                                        std::vector<Matrix2D<double>>(n_class, Matrix2D<double>(4, this->_l_motif, 0.))) ;
+    this->run_on_slices([this, &partials](size_t slice, size_t from, size_t to)
+                        {   if(this->_sparse)
+                            {   this->compute_motifs_sparse_routine(from, to, partials[slice]) ; }
+                            else if(this->_hard)
+                            {   this->compute_motifs_hard_routine(from, to, partials[slice]) ; }
+                            else
+                            {   this->compute_motifs_routine(from, to, partials[slice]) ; }
+                        }) ;
+    this->reduce_motif_counts(partials) ;
+    return partials[0] ;
+}
 
-                for(size_t i=0; i<this->_n_seq; i++)
-                {   char base = this->_sequences(i, s+j) ;
+template<class T>
+void EMSequenceEngine<T>::compute_motifs_routine(size_t from, size_t to,
+                                                 std::vector<Matrix2D<double>>& counts) const
+{   size_t n_class = counts.size() ;
+    size_t l_motif = this->_l_motif ;
+    // base counts of the current shift state, flat
+    // [class][motif position][base][strand] array such that both
+    // strand counts of a base are updated together
+    std::vector<double> base_prob(n_class*l_motif*4*2) ;
+    const PackedSequenceSet& sequences = *this->_sequences ;
+
+    // s is the index within the band
+    for(size_t s=0; s<this->_n_shift_band; s++)
+    {   std::fill(base_prob.begin(), base_prob.end(), 0.) ;
+
+        // the posterior prob of consecutive sequences are contiguous
+        // for a given shift and flip state
+        for(size_t i=from; i<to; i++)
+        {   for(size_t j=0; j<l_motif; j++)
+            {   size_t base = sequences(i, this->_shift_from+s+j) ;
+                for(size_t k=0; k<n_class; k++)
+                {   double* values = base_prob.data() + ((k*l_motif + j)*4)*2 ;
                     // forward strand
-                    {   base_prob[dna::hash(base)]           += this->_post_prob(i,k,s,Constants::FORWARD) ; }
-                    // reverse strand
+                    {   values[2*base + Constants::FORWARD]       += this->_post_prob(i,k,s,Constants::FORWARD) ; }
+                    // reverse strand (complement code)
                     if(this->_n_flip == 2)
-                    {   base_prob_rev[dna::hash(base, true)] += this->_post_prob(i,k,s,Constants::REVERSE) ; }
+                    {   values[2*(3 - base) + Constants::REVERSE] += this->_post_prob(i,k,s,Constants::REVERSE) ; }
                 }
+            }
+        }
 
-                for(size_t i=0,i_rev= base_prob.size()-1; i<4; i++,i_rev--)
+        for(size_t k=0; k<n_class; k++)
+        {   for(size_t j=0; j<l_motif; j++)
+            {   const double* values = base_prob.data() + ((k*l_motif + j)*4)*2 ;
+                for(size_t i=0; i<4; i++)
                 {   // forward strand
-                    {   this->_motifs[k](i,j)                  += base_prob[i] ; }
-                    // {   int corrected_j = j - corr ;
-                    //     if(corrected_j >= static_cast<int>(this->_l_motif) or
-                    //        corrected_j < 0)
-                    //     {   continue ; }
-                    // }
+                    {   counts[k](i,j)             += values[2*i + Constants::FORWARD] ; }
                     // reverse strand
                     if(this->_n_flip == 2)
-                    {   // this->_motifs(i_rev,j,k) += base_prob_rev[i] ;
-                        this->_motifs[k](i,this->_l_motif-j-1) += base_prob_rev[i] ;
-                    }
+                    {   counts[k](i,l_motif-j-1) += values[2*i + Constants::REVERSE] ; }
                 }
             }
         }
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_motifs_hard_routine(size_t from, size_t to,
+                                                      std::vector<Matrix2D<double>>& counts) const
+{   size_t n_class = counts.size() ;
+    size_t l_motif = this->_l_motif ;
+    const PackedSequenceSet& sequences = *this->_sequences ;
+    // the base counts, flat [class][base][position] array
+    std::vector<uint64_t> base_counts(n_class*4*l_motif, 0) ;
+    size_t k, s, f ;
+
+    for(size_t i=from; i<to; i++)
+    {   this->decode_state(this->_assignment[i], k, s, f) ;
+        // the background class is not trained
+        if(k >= n_class)
+        {   continue ; }
+        uint64_t* values = base_counts.data() + k*4*l_motif ;
+        for(size_t j=0; j<l_motif; j++)
+        {   size_t base = sequences(i, s+j) ;
+            // forward strand
+            if(f == Constants::FORWARD)
+            {   values[base*l_motif + j]++ ; }
+            // reverse strand (complement code)
+            else
+            {   values[(3-base)*l_motif + l_motif-j-1]++ ; }
+        }
+    }
+
+    for(size_t k=0; k<n_class; k++)
+    {   for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<l_motif; j++)
+            {   counts[k](i,j) += static_cast<double>(base_counts[(k*4 + i)*l_motif + j]) ; }
+        }
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_motifs_sparse_routine(size_t from, size_t to,
+                                                        std::vector<Matrix2D<double>>& counts) const
+{   size_t n_class = counts.size() ;
+    size_t l_motif = this->_l_motif ;
+    const PackedSequenceSet& sequences = *this->_sequences ;
+    size_t k, s, f ;
+
+    for(size_t i=from; i<to; i++)
+    {   for(const auto& state : this->_post_prob_sparse[i])
+        {   this->decode_state(state.first, k, s, f) ;
+            // the background class is not trained
+            if(k >= n_class)
+            {   continue ; }
+            double prob = state.second ;
+            for(size_t j=0; j<l_motif; j++)
+            {   size_t base = sequences(i, s+j) ;
+                // forward strand
+                if(f == Constants::FORWARD)
+                {   counts[k](base,j) += prob ; }
+                // reverse strand (complement code)
+                else
+                {   counts[k](3-base,l_motif-j-1) += prob ; }
+            }
+        }
+    }
+}
+
+template<class T>
+void EMSequenceEngine<T>::reduce_motif_counts(std::vector<std::vector<Matrix2D<double>>>& partials) const
+{   tree_reduce(partials, [this](std::vector<Matrix2D<double>>& lhs, const std::vector<Matrix2D<double>>& rhs)
+                          {   for(size_t k=0; k<lhs.size(); k++)
+                              {   for(size_t i=0; i<4; i++)
+                                  {   for(size_t j=0; j<this->_l_motif; j++)
+                                      {   lhs[k](i,j) += rhs[k](i,j) ; }
+                                  }
+                              }
+                          }) ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::update_motifs(const std::vector<Matrix2D<double>>& counts)
+{   for(size_t k=0; k<counts.size(); k++)
+    {   this->_motifs[k] = counts[k] ;
 
         // normalize the columns and avoid 0 values by adding some pseudocounts
         for(size_t j=0; j<this->_l_motif; j++)
@@ -418,75 +1553,744 @@ void EMSequenceEngine::compute_motifs()
     // {   std::cerr << motif << std::endl << std::endl ; }
 }
 
-void EMSequenceEngine::compute_likelihood()
-{   for(size_t k=0; k<this->_n_class; k++)
-    {
-        // compute the log prob motif and the log prob reverse-complement motif
-        size_t nrow = 4, ncol = this->_l_motif ;
+template<class T>
+std::vector<double> EMSequenceEngine<T>::compute_motifs_log() const
+{   // the background class is not scored
+    size_t n_class = this->_n_class - this->_bg_class ;
+    std::vector<Matrix2D<double>> motifs_log ;
+    for(size_t k=0; k<n_class; k++)
+    {   size_t nrow = 4, ncol = this->_l_motif ;
         Matrix2D<double> motif_log(nrow, ncol) ;
-        Matrix2D<double> motif_log_rev(nrow, ncol) ;
         for(size_t i=0; i<nrow; i++)
         {   for(size_t j=0; j<ncol; j++)
-            {   motif_log(i,j)                   = log(this->_motifs[k](i,j)) ;
-                motif_log_rev(nrow-i-1,ncol-j-1) = log(this->_motifs[k](i,j));
+            {   motif_log(i,j) = log(this->_motifs[k](i,j)) ; }
+        }
+        motifs_log.push_back(motif_log) ;
+    }
+    // the motifs of all classes (and their reverse complement) are
+    // interleaved, the motif index being k*_n_flip + flip
+    return dna::interleave_motifs(motifs_log, this->_n_flip == 2) ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_likelihood()
+{   // compute the log prob motifs, interleaved with the log prob reverse-complement motifs
+    std::vector<double> motifs_log = this->compute_motifs_log() ;
+
+    this->run_on_chunks([this, &motifs_log](size_t from, size_t to)
+                        {   this->compute_likelihood_routine(from, to, motifs_log) ; }) ;
+
+    // std::cerr << "likelihoods" << std::endl ;
+    // std::cerr << this->_likelihood << std::endl << std::endl ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_likelihood_routine(size_t from, size_t to,
+                                                     const std::vector<double>& motifs_log)
+{   size_t n_class = this->_n_class - this->_bg_class ;
+    size_t n_motif = n_class*this->_n_flip ;
+    std::vector<int32_t> sequence ;
+    // the part of the sequence spanned by the shift band
+    std::vector<int32_t> window ;
+    // the scores of all classes and flip states, flat [shift][class][flip] array
+    std::vector<double> scores ;
+    for(size_t i=from; i<to; i++)
+    {   this->_sequences->decode(i, sequence) ;
+        window.assign(sequence.begin() + this->_shift_from,
+                      sequence.begin() + this->_shift_from + this->_n_shift_band + this->_l_motif - 1) ;
+        // all classes and both strands in a single pass
+        dna::score_all_shifts_all_motifs(window, motifs_log, n_motif, scores) ;
+        for(size_t k=0; k<n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++)
+                {   this->_likelihood(i,k,s,f) = scores[(s*n_class + k)*this->_n_flip + f] ; }
+            }
+        }
+        // background class, computed once
+        if(this->_bg_class)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++)
+                {   this->_likelihood(i,n_class,s,f) = this->_bg_likelihood(i,this->_shift_from+s,f) ; }
             }
         }
+    }
+}
 
-        // std::cerr << motif_log << std::endl<<std::endl ;
-        // std::cerr << motif_log_rev << std::endl << "---------------------------------------" << std::endl ;
+template<class T>
+void EMSequenceEngine<T>::compute_posterior_prob()
+{   Matrix3D<double> class_prob_log = this->compute_class_prob_log() ;
+    // the largest change over all chunks, the result does not depend on
+    // the order in which the chunks are processed
+    this->_post_prob_delta = 0. ;
+    std::mutex mutex ;
+    this->run_on_chunks([this, &class_prob_log, &mutex](size_t from, size_t to)
+                        {   double delta = this->compute_posterior_prob_routine(from, to, class_prob_log) ;
+                            std::lock_guard<std::mutex> lock(mutex) ;
+                            this->_post_prob_delta = std::max(this->_post_prob_delta, delta) ;
+                        }) ;
+    this->update_log_likelihood() ;
 
-        for(size_t i=0; i<this->_n_seq; i++)
-        {   for(size_t s=0; s<this->_n_shift; s++)
-            {   // forward strand
-                {   this->_likelihood(i,k,s,Constants::FORWARD) = exp(dna::score_sequence(this->_sequences, i, s, motif_log)) ; }
-                // reverse strand
-                if(this->_n_flip == 2)
-                {   this->_likelihood(i,k,s,Constants::REVERSE) = exp(dna::score_sequence(this->_sequences, i, s, motif_log_rev)) ; }
+    // std::cerr << "posteriors" << std::endl ;
+    // std::cerr << this->_post_prob << std::endl << std::endl ;
+}
+
+template<class T>
+double EMSequenceEngine<T>::compute_posterior_prob_routine(size_t from, size_t to,
+                                                           const Matrix3D<double>& class_prob_log)
+{   // the log posterior prob of the current sequence, flat
+    // [class][shift][flip] array
+    std::vector<double> post_prob(this->_n_class*this->_n_shift_band*this->_n_flip) ;
+    // the largest absolute change of a posterior prob
+    double delta = 0. ;
+
+    for(size_t i=from; i<to; i++)
+    {   // compute
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   post_prob[n] = this->_likelihood(i,k,s,f) + class_prob_log(k,this->_shift_from+s,f) ; }
+            }
+        }
+        // normalize, the normalizing constant is the sequence likelihood
+        this->_log_likelihood_seq[i] = log_normalize(post_prob) ;
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   T value = this->to_post_prob(post_prob[n]) ;
+                    delta   = std::max(delta, static_cast<double>(std::abs(value - this->_post_prob(i,k,s,f)))) ;
+                    this->_post_prob(i,k,s,f) = value ;
+                }
             }
         }
     }
+    return delta ;
+}
 
-    // std::cerr << "likelihoods" << std::endl ;
-    // std::cerr << this->_likelihood << std::endl << std::endl ;
+template<class T>
+void EMSequenceEngine<T>::compute_posterior_prob_sparse()
+{   std::vector<double> motifs_log = this->compute_motifs_log() ;
+    Matrix3D<double> class_prob_log = this->compute_class_prob_log() ;
+    // all the states are scored periodically
+    bool rescore = this->_sparse_n_step % Constants::sparse_period == 0 ;
+
+    this->_post_prob_delta = 0. ;
+    std::mutex mutex ;
+    this->run_on_chunks([this, &motifs_log, &class_prob_log, rescore, &mutex](size_t from, size_t to)
+                        {   double delta = this->compute_posterior_prob_sparse_routine(from, to,
+                                                                                       motifs_log,
+                                                                                       class_prob_log,
+                                                                                       rescore) ;
+                            std::lock_guard<std::mutex> lock(mutex) ;
+                            this->_post_prob_delta = std::max(this->_post_prob_delta, delta) ;
+                        }) ;
+    this->update_log_likelihood() ;
+    this->_sparse_n_step++ ;
+    this->_sparse_full = rescore ;
 }
 
-void EMSequenceEngine::compute_posterior_prob()
-{   // compute
-    for(size_t i=0; i<this->_n_seq; i++)
+template<class T>
+double EMSequenceEngine<T>::compute_posterior_prob_sparse_routine(size_t from, size_t to,
+                                                                  const std::vector<double>& motifs_log,
+                                                                  const Matrix3D<double>& class_prob_log,
+                                                                  bool rescore)
+{   size_t n_class = this->_n_class - this->_bg_class ;
+    size_t n_motif = n_class*this->_n_flip ;
+    size_t n_state = this->_n_class*this->_n_shift*this->_n_flip ;
+    std::vector<int32_t> sequence ;
+    // the scores of all trained classes and flip states, flat
+    // [shift][class][flip] array
+    std::vector<double> scores ;
+    // the log posterior prob of the scored states of the current sequence
+    std::vector<double> post_prob ;
+    // the previous posterior prob of all the states of the current sequence
+    std::vector<T> post_prob_prev ;
+    // the state indices, by decreasing posterior prob
+    std::vector<size_t> order ;
+    // the largest absolute change of a posterior prob
+    double delta = 0. ;
+    size_t k, s, f ;
+
+    for(size_t i=from; i<to; i++)
+    {   std::vector<std::pair<uint32_t,T>>& states = this->_post_prob_sparse[i] ;
+        this->_sequences->decode(i, sequence) ;
+        // all the states
+        if(rescore)
+        {   dna::score_all_shifts_all_motifs(sequence, motifs_log, n_motif, scores) ;
+            post_prob.resize(n_state) ;
+            for(size_t n=0; n<n_state; n++)
+            {   this->decode_state(n, k, s, f) ;
+                // background class, computed once
+                double log_likelihood = k == n_class ?
+                                        static_cast<double>(this->_bg_likelihood(i,s,f)) :
+                                        scores[(s*n_class + k)*this->_n_flip + f] ;
+                post_prob[n] = log_likelihood + class_prob_log(k,s,f) ;
+            }
+            this->_log_likelihood_seq[i] = log_normalize(post_prob) ;
+
+            post_prob_prev.assign(n_state, Constants::pseudo_counts) ;
+            for(const auto& state : states)
+            {   post_prob_prev[state.first] = state.second ; }
+            // the smallest set of states holding 1-threshold of the
+            // probability mass is kept, the most likely states first
+            order.resize(n_state) ;
+            std::iota(order.begin(), order.end(), 0) ;
+            std::sort(order.begin(), order.end(),
+                      [&post_prob](size_t a, size_t b)
+                      {   return post_prob[a] > post_prob[b] or (post_prob[a] == post_prob[b] and a < b) ; }) ;
+            double prob_kept = 0. ;
+            size_t n_kept    = 0 ;
+            while(n_kept < n_state and prob_kept < 1. - this->_sparse_threshold)
+            {   prob_kept += post_prob[order[n_kept]] ;
+                n_kept++ ;
+            }
+            // the kept states are normalized, as between two rescorings,
+            // the pruned ones are flagged with a negative value
+            for(size_t n=n_kept; n<n_state; n++)
+            {   post_prob[order[n]] = -1. ; }
+            // the mass of the pruned states is accounted for in the
+            // log likelihood until the next rescoring
+            this->_sparse_log_mass[i] = log(prob_kept) ;
+            std::vector<std::pair<uint32_t,T>> states_kept ;
+            for(size_t n=0; n<n_state; n++)
+            {   T value = post_prob[n] < 0. ?
+                          static_cast<T>(Constants::pseudo_counts) :
+                          this->to_post_prob(post_prob[n] / prob_kept) ;
+                delta   = std::max(delta, static_cast<double>(std::abs(value - post_prob_prev[n]))) ;
+                if(post_prob[n] >= 0.)
+                {   states_kept.emplace_back(n, value) ; }
+            }
+            // exact capacity
+            std::vector<std::pair<uint32_t,T>>(states_kept).swap(states) ;
+        }
+        // the kept states only
+        else
+        {   post_prob.resize(states.size()) ;
+            for(size_t n=0; n<states.size(); n++)
+            {   this->decode_state(states[n].first, k, s, f) ;
+                double log_likelihood = 0. ;
+                // background class, computed once
+                if(k == n_class)
+                {   log_likelihood = this->_bg_likelihood(i,s,f) ; }
+                else
+                {   size_t m = k*this->_n_flip + f ;
+                    for(size_t j=0; j<this->_l_motif; j++)
+                    {   log_likelihood += motifs_log[(4*j + sequence[s+j])*n_motif + m] ; }
+                }
+                post_prob[n] = log_likelihood + class_prob_log(k,s,f) ;
+            }
+            this->_log_likelihood_seq[i] = log_normalize(post_prob) - this->_sparse_log_mass[i] ;
+            for(size_t n=0; n<states.size(); n++)
+            {   T value = this->to_post_prob(post_prob[n]) ;
+                delta   = std::max(delta, static_cast<double>(std::abs(value - states[n].second))) ;
+                states[n].second = value ;
+            }
+        }
+    }
+    return delta ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_assignment()
+{   std::vector<double> motifs_log = this->compute_motifs_log() ;
+    Matrix3D<double> class_prob_log = this->compute_class_prob_log() ;
+
+    size_t n_changed = 0 ;
+    std::mutex mutex ;
+    this->run_on_chunks([this, &motifs_log, &class_prob_log, &n_changed, &mutex](size_t from, size_t to)
+                        {   size_t n = this->compute_assignment_routine(from, to, motifs_log, class_prob_log) ;
+                            std::lock_guard<std::mutex> lock(mutex) ;
+                            n_changed += n ;
+                        }) ;
+    // the posterior probabilities are 0 or 1
+    this->_post_prob_delta = n_changed ? 1. : 0. ;
+    this->update_log_likelihood() ;
+}
+
+template<class T>
+size_t EMSequenceEngine<T>::compute_assignment_routine(size_t from, size_t to,
+                                                       const std::vector<double>& motifs_log,
+                                                       const Matrix3D<double>& class_prob_log)
+{   size_t n_class = this->_n_class - this->_bg_class ;
+    size_t n_motif = n_class*this->_n_flip ;
+    std::vector<int32_t> sequence ;
+    // the part of the sequence spanned by the shift band
+    std::vector<int32_t> window ;
+    size_t shift_from = this->_shift_from ;
+    // the scores of all trained classes and flip states, flat
+    // [shift][class][flip] array
+    std::vector<double> scores ;
+    size_t n_changed = 0 ;
+
+    for(size_t i=from; i<to; i++)
+    {   this->_sequences->decode(i, sequence) ;
+        window.assign(sequence.begin() + shift_from,
+                      sequence.begin() + shift_from + this->_n_shift_band + this->_l_motif - 1) ;
+        dna::score_all_shifts_all_motifs(window, motifs_log, n_motif, scores) ;
+        double log_prob_max = -std::numeric_limits<double>::infinity() ;
+        size_t state_max    = this->_assignment[i] ;
+        for(size_t k=0; k<this->_n_class; k++)
+        {   for(size_t s=shift_from; s<shift_from+this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++)
+                {   // background class, computed once
+                    double log_likelihood = k == n_class ?
+                                            static_cast<double>(this->_bg_likelihood(i,s,f)) :
+                                            scores[((s-shift_from)*n_class + k)*this->_n_flip + f] ;
+                    double log_prob = log_likelihood + class_prob_log(k,s,f) ;
+                    if(log_prob > log_prob_max)
+                    {   log_prob_max = log_prob ;
+                        state_max    = (k*this->_n_shift + s)*this->_n_flip + f ;
+                    }
+                }
+            }
+        }
+        this->_log_likelihood_seq[i] = log_prob_max ;
+        if(state_max != this->_assignment[i])
+        {   this->_assignment[i] = state_max ;
+            n_changed++ ;
+        }
+    }
+    return n_changed ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::decode_state(size_t state, size_t& k, size_t& s, size_t& f) const
+{   f     = state % this->_n_flip ;
+    state = state / this->_n_flip ;
+    s     = state % this->_n_shift ;
+    k     = state / this->_n_shift ;
+}
+
+template<class T>
+Matrix4D<T> EMSequenceEngine<T>::unpack_post_prob() const
+{   Matrix4D<T> post_prob(this->_n_seq, this->_n_class, this->_n_shift, this->_n_flip, Constants::pseudo_counts) ;
+    size_t k, s, f ;
+    for(size_t i=0; i<this->_post_prob_sparse.size(); i++)
+    {   for(const auto& state : this->_post_prob_sparse[i])
+        {   this->decode_state(state.first, k, s, f) ;
+            post_prob(i,k,s,f) = state.second ;
+        }
+    }
+    return post_prob ;
+}
+
+template<class T>
+Matrix4D<T> EMSequenceEngine<T>::unpack_assignment() const
+{   Matrix4D<T> post_prob(this->_n_seq, this->_n_class, this->_n_shift, this->_n_flip, Constants::pseudo_counts) ;
+    size_t k, s, f ;
+    for(size_t i=0; i<this->_assignment.size(); i++)
+    {   this->decode_state(this->_assignment[i], k, s, f) ;
+        post_prob(i,k,s,f) = 1. ;
+    }
+    return post_prob ;
+}
+
+template<class T>
+Matrix3D<double> EMSequenceEngine<T>::compute_class_prob_log() const
+{   Matrix3D<double> class_prob_log(this->_n_class, this->_n_shift, this->_n_flip) ;
+    for(size_t k=0; k<this->_n_class; k++)
+    {   for(size_t s=0; s<this->_n_shift; s++)
+        {   for(size_t f=0; f<this->_n_flip; f++)
+            {   class_prob_log(k,s,f) = log(this->_class_prob(k,s,f)) ; }
+        }
+    }
+    return class_prob_log ;
+}
+
+template<class T>
+T EMSequenceEngine<T>::to_post_prob(double prob)
+{   // avoid 0 values, also when the value underflows in T
+    T value = static_cast<T>(prob) ;
+    if(value == 0.)
+    {   value = Constants::pseudo_counts ; }
+    return value ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_em_fused()
+{   std::vector<double> motifs_log = this->compute_motifs_log() ;
+    Matrix3D<double> class_prob_log = this->compute_class_prob_log() ;
+
+    // each slice of sequences computes its own posterior prob sums and
+    // base counts
+    size_t n_class = this->_n_class - this->_bg_class ;
+    std::vector<Matrix3D<double>> class_partials(this->get_slice_number(),
+                                                 Matrix3D<double>(this->_n_class, this->_n_shift, this->_n_flip, 0.)) ;
+    std::vector<std::vector<Matrix2D<double>>> motif_partials(this->get_slice_number(),
+                                                              std::vector<Matrix2D<double>>(n_class, Matrix2D<double>(4, this->_l_motif, 0.))) ;
+    std::vector<double> delta_partials(this->get_slice_number(), 0.) ;
+    this->run_on_slices([this, &motifs_log, &class_prob_log, &class_partials, &motif_partials, &delta_partials]
+                        (size_t slice, size_t from, size_t to)
+                        {   delta_partials[slice] = this->compute_em_fused_routine(from, to,
+                                                                                   motifs_log,
+                                                                                   class_prob_log,
+                                                                                   class_partials[slice],
+                                                                                   motif_partials[slice]) ;
+                        }) ;
+    this->_post_prob_delta = *std::max_element(delta_partials.begin(), delta_partials.end()) ;
+    this->update_log_likelihood() ;
+    this->reduce_class_prob(class_partials) ;
+    this->reduce_motif_counts(motif_partials) ;
+
+    this->update_class_prob(class_partials[0]) ;
+    this->update_motifs(motif_partials[0]) ;
+}
+
+template<class T>
+double EMSequenceEngine<T>::compute_em_fused_routine(size_t from, size_t to,
+                                                     const std::vector<double>& motifs_log,
+                                                     const Matrix3D<double>& class_prob_log,
+                                                     Matrix3D<double>& class_prob,
+                                                     std::vector<Matrix2D<double>>& counts)
+{   size_t n_class = counts.size() ;
+    size_t l_motif = this->_l_motif ;
+    // the posterior prob of the current sequence, flat
+    // [class][shift][flip] array
+    std::vector<double> post_prob(this->_n_class*this->_n_shift_band*this->_n_flip) ;
+    size_t n_motif = n_class*this->_n_flip ;
+    std::vector<int32_t> sequence ;
+    // the part of the sequence spanned by the shift band
+    std::vector<int32_t> window ;
+    const PackedSequenceSet& sequences = *this->_sequences ;
+    size_t shift_from = this->_shift_from ;
+    // the scores of all trained classes and flip states, flat
+    // [shift][class][flip] array
+    std::vector<double> scores ;
+    // the largest absolute change of a posterior prob
+    double delta = 0. ;
+
+    for(size_t i=from; i<to; i++)
+    {   // E-step, the likelihood are not stored
+        this->_sequences->decode(i, sequence) ;
+        window.assign(sequence.begin() + shift_from,
+                      sequence.begin() + shift_from + this->_n_shift_band + l_motif - 1) ;
+        dna::score_all_shifts_all_motifs(window, motifs_log, n_motif, scores) ;
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   // background class, computed once
+                    double log_likelihood = k == n_class ?
+                                            static_cast<double>(this->_bg_likelihood(i,shift_from+s,f)) :
+                                            scores[(s*n_class + k)*this->_n_flip + f] ;
+                    post_prob[n] = log_likelihood + class_prob_log(k,shift_from+s,f) ;
+                }
+            }
+        }
+        this->_log_likelihood_seq[i] = log_normalize(post_prob) ;
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   T value = this->to_post_prob(post_prob[n]) ;
+                    delta   = std::max(delta, static_cast<double>(std::abs(value - this->_post_prob(i,k,s,f)))) ;
+                    this->_post_prob(i,k,s,f) = value ;
+                    // accumulate the stored value, as in the regular M-step
+                    post_prob[n]                  = value ;
+                    class_prob(k,shift_from+s,f) += value ;
+                }
+            }
+        }
+
+        // M-step, the sequence contributes to the base counts right away
+        for(size_t s=0; s<this->_n_shift_band; s++)
+        {   for(size_t j=0; j<l_motif; j++)
+            {   size_t base = sequences(i, shift_from+s+j) ;
+                for(size_t k=0; k<n_class; k++)
+                {   size_t n = (k*this->_n_shift_band + s)*this->_n_flip ;
+                    // forward strand
+                    {   counts[k](base,j)                 += post_prob[n+Constants::FORWARD] ; }
+                    // reverse strand (complement code)
+                    if(this->_n_flip == 2)
+                    {   counts[k](3-base,l_motif-j-1) += post_prob[n+Constants::REVERSE] ; }
+                }
+            }
+        }
+    }
+    return delta ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::compute_em_incremental()
+{   // a change of the shift band invalidates the cache
+    size_t shift_from   = this->_shift_from ;
+    size_t n_shift_band = this->_n_shift_band ;
+    this->update_shift_band() ;
+    bool full = (this->_incremental_n_step % Constants::incremental_period == 0) or
+                this->_active_seq.empty() or
+                (shift_from != this->_shift_from) or
+                (n_shift_band != this->_n_shift_band) ;
+    if(full)
+    {   this->_incremental_n_step = 0 ;
+        this->_active_seq.resize(this->_n_seq) ;
+        std::iota(this->_active_seq.begin(), this->_active_seq.end(), 0) ;
+    }
+
+    std::vector<double> motifs_log = this->compute_motifs_log() ;
+    Matrix3D<double> class_prob_log = this->compute_class_prob_log() ;
+
+    // each slice of active sequences computes its own posterior prob
+    // sums and base counts (or their changes)
+    size_t n_class = this->_n_class - this->_bg_class ;
+    std::vector<Matrix3D<double>> class_partials(this->get_slice_number(),
+                                                 Matrix3D<double>(this->_n_class, this->_n_shift, this->_n_flip, 0.)) ;
+    std::vector<std::vector<Matrix2D<double>>> motif_partials(this->get_slice_number(),
+                                                              std::vector<Matrix2D<double>>(n_class, Matrix2D<double>(4, this->_l_motif, 0.))) ;
+    std::vector<double> delta_partials(this->get_slice_number(), 0.) ;
+    this->run_on_slices(this->_active_seq.size(),
+                        [this, &motifs_log, &class_prob_log, full, &class_partials, &motif_partials, &delta_partials]
+                        (size_t slice, size_t from, size_t to)
+                        {   delta_partials[slice] = this->compute_em_incremental_routine(from, to,
+                                                                                         motifs_log,
+                                                                                         class_prob_log,
+                                                                                         full,
+                                                                                         class_partials[slice],
+                                                                                         motif_partials[slice]) ;
+                        }) ;
+    this->_post_prob_delta = *std::max_element(delta_partials.begin(), delta_partials.end()) ;
+    this->update_log_likelihood() ;
+    this->reduce_class_prob(class_partials) ;
+    this->reduce_motif_counts(motif_partials) ;
+
+    // update the cache
+    if(full)
+    {   this->_post_prob_sum_cache = class_partials[0] ;
+        this->_motif_counts_cache  = motif_partials[0] ;
+    }
+    else
     {   for(size_t k=0; k<this->_n_class; k++)
         {   for(size_t s=0; s<this->_n_shift; s++)
             {   for(size_t f=0; f<this->_n_flip; f++)
-                {   // add pseudo counts to avoid 0 values
-                    this->_post_prob(i,k,s,f) = (this->_likelihood(i,k,s,f) * this->_class_prob(k,s,f)) ;
+                {   this->_post_prob_sum_cache(k,s,f) += class_partials[0](k,s,f) ; }
+            }
+        }
+        for(size_t k=0; k<n_class; k++)
+        {   for(size_t i=0; i<4; i++)
+            {   for(size_t j=0; j<this->_l_motif; j++)
+                {   this->_motif_counts_cache[k](i,j) += motif_partials[0][k](i,j) ; }
+            }
+        }
+    }
+    this->_incremental_full = full ;
+    this->_incremental_n_step++ ;
+
+    // freeze the sequences which did not change enough
+    std::vector<size_t> active_seq ;
+    for(auto i : this->_active_seq)
+    {   if(this->_post_prob_delta_seq[i] > this->_incremental_threshold)
+        {   active_seq.push_back(i) ; }
+    }
+    this->_active_seq.swap(active_seq) ;
+
+    this->update_class_prob(this->_post_prob_sum_cache) ;
+    this->update_motifs(this->_motif_counts_cache) ;
+}
+
+template<class T>
+double EMSequenceEngine<T>::compute_em_incremental_routine(size_t from, size_t to,
+                                                           const std::vector<double>& motifs_log,
+                                                           const Matrix3D<double>& class_prob_log,
+                                                           bool full,
+                                                           Matrix3D<double>& class_prob,
+                                                           std::vector<Matrix2D<double>>& counts)
+{   size_t n_class = counts.size() ;
+    size_t l_motif = this->_l_motif ;
+    // the posterior prob of the current sequence and then the weights of
+    // its contribution, flat [class][shift][flip] array
+    std::vector<double> post_prob(this->_n_class*this->_n_shift_band*this->_n_flip) ;
+    size_t n_motif = n_class*this->_n_flip ;
+    std::vector<int32_t> sequence ;
+    // the part of the sequence spanned by the shift band
+    std::vector<int32_t> window ;
+    const PackedSequenceSet& sequences = *this->_sequences ;
+    size_t shift_from = this->_shift_from ;
+    // the scores of all trained classes and flip states, flat
+    // [shift][class][flip] array
+    std::vector<double> scores ;
+    // the largest absolute change of a posterior prob
+    double delta = 0. ;
+
+    for(size_t a=from; a<to; a++)
+    {   size_t i = this->_active_seq[a] ;
+        // E-step, the likelihood are not stored
+        this->_sequences->decode(i, sequence) ;
+        window.assign(sequence.begin() + shift_from,
+                      sequence.begin() + shift_from + this->_n_shift_band + l_motif - 1) ;
+        dna::score_all_shifts_all_motifs(window, motifs_log, n_motif, scores) ;
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   // background class, computed once
+                    double log_likelihood = k == n_class ?
+                                            static_cast<double>(this->_bg_likelihood(i,shift_from+s,f)) :
+                                            scores[(s*n_class + k)*this->_n_flip + f] ;
+                    post_prob[n] = log_likelihood + class_prob_log(k,shift_from+s,f) ;
+                }
+            }
+        }
+        this->_log_likelihood_seq[i] = log_normalize(post_prob) ;
+        double delta_seq = 0. ;
+        for(size_t k=0, n=0; k<this->_n_class; k++)
+        {   for(size_t s=0; s<this->_n_shift_band; s++)
+            {   for(size_t f=0; f<this->_n_flip; f++, n++)
+                {   T value     = this->to_post_prob(post_prob[n]) ;
+                    T value_old = this->_post_prob(i,k,s,f) ;
+                    delta_seq   = std::max(delta_seq, static_cast<double>(std::abs(value - value_old))) ;
+                    this->_post_prob(i,k,s,f) = value ;
+                    // the contribution or its change
+                    post_prob[n] = full ?
+                                   static_cast<double>(value) :
+                                   static_cast<double>(value) - static_cast<double>(value_old) ;
+                    class_prob(k,shift_from+s,f) += post_prob[n] ;
+                }
+            }
+        }
+        this->_post_prob_delta_seq[i] = delta_seq ;
+        delta = std::max(delta, delta_seq) ;
+
+        // M-step
+        for(size_t s=0; s<this->_n_shift_band; s++)
+        {   for(size_t j=0; j<l_motif; j++)
+            {   size_t base = sequences(i, shift_from+s+j) ;
+                for(size_t k=0; k<n_class; k++)
+                {   size_t n = (k*this->_n_shift_band + s)*this->_n_flip ;
+                    // forward strand
+                    {   counts[k](base,j)                 += post_prob[n+Constants::FORWARD] ; }
+                    // reverse strand (complement code)
+                    if(this->_n_flip == 2)
+                    {   counts[k](3-base,l_motif-j-1) += post_prob[n+Constants::REVERSE] ; }
                 }
             }
         }
     }
-    // normalize
-    for(size_t i=0; i<this->_n_seq; i++)
-    {   double sum = 0. ;
+    return delta ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::update_log_likelihood()
+{   // sums in the sequence order, the result does not depend on the
+    // number of threads
+    this->_log_likelihood_prev = this->_log_likelihood ;
+    this->_log_likelihood      = std::accumulate(this->_log_likelihood_seq.begin(),
+                                                 this->_log_likelihood_seq.end(), 0.) ;
+}
+
+template<class T>
+void EMSequenceEngine<T>::update_shift_band()
+{   // the window around the central shift
+    size_t center = this->_n_shift / 2 ;
+    size_t from   = this->_shift_window < center ? center - this->_shift_window : 0 ;
+    size_t to     = this->_shift_window < this->_n_shift - center ?
+                    center + this->_shift_window : this->_n_shift - 1 ;
+
+    // the shifts with enough prior mass, within the window
+    if(this->_shift_threshold > 0.)
+    {   std::vector<double> shift_prob(this->_n_shift, 0.) ;
         for(size_t k=0; k<this->_n_class; k++)
         {   for(size_t s=0; s<this->_n_shift; s++)
             {   for(size_t f=0; f<this->_n_flip; f++)
-                {   sum += this->_post_prob(i,k,s,f) ; }
+                {   shift_prob[s] += this->_class_prob(k,s,f) ; }
             }
         }
-        for(size_t k=0; k<this->_n_class; k++)
-        {   for(size_t s=0; s<this->_n_shift; s++)
+        size_t s_max = from ;
+        for(size_t s=from; s<=to; s++)
+        {   if(shift_prob[s] > shift_prob[s_max])
+            {   s_max = s ; }
+        }
+        // the most likely shift is always kept
+        size_t from_mass = s_max, to_mass = s_max ;
+        for(size_t s=from; s<=to; s++)
+        {   if(shift_prob[s] >= this->_shift_threshold)
+            {   from_mass = std::min(from_mass, s) ;
+                to_mass   = std::max(to_mass, s) ;
+            }
+        }
+        from = from_mass ;
+        to   = to_mass ;
+    }
+
+    size_t n_shift_band = to - from + 1 ;
+    if(from == this->_shift_from and n_shift_band == this->_n_shift_band)
+    {   return ; }
+
+    // the assignments do not depend on the band
+    if(this->_hard)
+    {   this->_shift_from   = from ;
+        this->_n_shift_band = n_shift_band ;
+        return ;
+    }
+    // the likelihood are allocated again, to the new band, before the
+    // next E-step
+    this->_likelihood = Matrix4D<T>() ;
+    // the posterior prob are kept over the shifts common to both bands,
+    // the other shifts are considered to have pseudo counts
+    Matrix4D<T> post_prob(this->_n_seq, this->_n_class, n_shift_band, this->_n_flip, Constants::pseudo_counts) ;
+    size_t common_from = std::max(from, this->_shift_from) ;
+    size_t common_to   = std::min(to, this->_shift_from + this->_n_shift_band - 1) ;
+    for(size_t i=0; i<this->_n_seq; i++)
+    {   for(size_t k=0; k<this->_n_class; k++)
+        {   for(size_t s=common_from; s<=common_to; s++)
             {   for(size_t f=0; f<this->_n_flip; f++)
-                {   this->_post_prob(i,k,s,f) = this->_post_prob(i,k,s,f) / sum;
-                    if(this->_post_prob(i,k,s,f) == 0.)
-                    {   this->_post_prob(i,k,s,f) = Constants::pseudo_counts ; }
-                }
+                {   post_prob(i,k,s-from,f) = this->_post_prob(i,k,s-this->_shift_from,f) ; }
             }
         }
     }
+    this->_post_prob    = std::move(post_prob) ;
+    this->_shift_from   = from ;
+    this->_n_shift_band = n_shift_band ;
+}
 
-    // std::cerr << "posteriors" << std::endl ;
-    // std::cerr << this->_post_prob << std::endl << std::endl ;
+template<class T>
+void EMSequenceEngine<T>::run_on_chunks(const std::function<void(size_t,size_t)>& routine) const
+{   // number of sequences per chunk, such that the likelihood and the
+    // posterior probabilities of a chunk fit in cache
+    size_t seq_size   = 2 * this->_n_class * this->_n_shift_band * this->_n_flip * sizeof(double) ;
+    size_t chunk_size = std::max(static_cast<size_t>(1), Constants::chunk_size / seq_size) ;
+    // at least one chunk per thread
+    if(chunk_size * this->_n_threads > this->_n_seq)
+    {   chunk_size = std::max(static_cast<size_t>(1), (this->_n_seq + this->_n_threads - 1) / this->_n_threads) ; }
+
+    // serial
+    if(this->_n_threads == 1)
+    {   for(size_t from=0; from<this->_n_seq; from+=chunk_size)
+        {   routine(from, std::min(from+chunk_size, this->_n_seq)) ; }
+        return ;
+    }
+    // parallel
+    ThreadPool pool(this->_n_threads) ;
+    for(size_t from=0; from<this->_n_seq; from+=chunk_size)
+    {   pool.addJob(std::bind(routine, from, std::min(from+chunk_size, this->_n_seq))) ; }
+    pool.join() ;
+}
+
+template<class T>
+size_t EMSequenceEngine<T>::get_slice_number() const
+{   return std::max(static_cast<size_t>(1), std::min(this->_n_threads, this->_n_seq)) ; }
+
+template<class T>
+void EMSequenceEngine<T>::run_on_slices(const std::function<void(size_t,size_t,size_t)>& routine) const
+{   this->run_on_slices(this->_n_seq, routine) ; }
+
+template<class T>
+void EMSequenceEngine<T>::run_on_slices(size_t n,
+                                        const std::function<void(size_t,size_t,size_t)>& routine) const
+{   size_t n_slice    = this->get_slice_number() ;
+    size_t slice_size = (n + n_slice - 1) / n_slice ;
+
+    // serial
+    if(n_slice == 1)
+    {   routine(0, 0, n) ;
+        return ;
+    }
+    // parallel
+    ThreadPool pool(n_slice) ;
+    for(size_t slice=0; slice<n_slice; slice++)
+    {   size_t from = std::min(slice*slice_size, n) ;
+        size_t to   = std::min(from+slice_size, n) ;
+        pool.addJob(std::bind(routine, slice, from, to)) ;
+    }
+    pool.join() ;
 }
 
-void EMSequenceEngine::normalise_motifs()
+template<class T>
+void EMSequenceEngine<T>::normalise_motifs()
 {
     size_t n_class = this->_n_class - this->_bg_class ;
 
@@ -540,7 +2344,8 @@ void EMSequenceEngine::normalise_motifs()
  *
  */
 
-int EMSequenceEngine::debug()
+template<class T>
+int EMSequenceEngine<T>::debug()
 {
     // compute the information content OF CLASS 1 ONLY
     std::vector<double> info_cont = this->compute_information_content() ;
@@ -576,7 +2381,8 @@ int EMSequenceEngine::debug()
 }
 
 
-std::vector<double> EMSequenceEngine::compute_information_content() const
+template<class T>
+std::vector<double> EMSequenceEngine<T>::compute_information_content() const
 {   std::vector<double> H(this->_l_motif,0) ; // enthropy
     std::vector<double> R(this->_l_motif,0) ; // information content
 
@@ -615,7 +2421,8 @@ std::vector<double> EMSequenceEngine::compute_information_content() const
 }
 
 
-void EMSequenceEngine::print_alignment() const
+template<class T>
+void EMSequenceEngine<T>::print_alignment() const
 {
     for(size_t k=0; k<this->_n_class; k++)
     {   std::cerr << "class " << k+1 << std::endl ;
@@ -624,7 +2431,7 @@ void EMSequenceEngine::print_alignment() const
             {   for(size_t s=0; s<this->_n_shift; s++)
                 {   // print the subseq
                     for(size_t j=0; j<this->_l_motif; j++)
-                    {   std::cerr << this->_sequences(i,j+s) ; }
+                    {   std::cerr << this->_sequences->get_char(i,j+s) ; }
                     // print the prob
                     std::cerr << "    " << std::setprecision(4) << this->_post_prob(i,k,s,f) << std::endl ;
                 }
@@ -635,8 +2442,6 @@ void EMSequenceEngine::print_alignment() const
 }
 
 
-
-
-
-
-
+// explicit instantiations
+template class EMSequenceEngine<float> ;
+template class EMSequenceEngine<double> ;
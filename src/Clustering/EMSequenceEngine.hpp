@@ -5,13 +5,29 @@
 
 #include <iostream>
 #include <vector>
+#include <functional>            // std::function
+#include <memory>                // std::shared_ptr
+#include <random>                // std::mt19937
+#include <utility>               // std::pair
+#include <cstdint>               // uint32_t
 #include <stdexcept>             // std::runtime_error
 #include "Utility/Constants.hpp" // clustering_codes
 #include "Matrix/Matrix2D.hpp"
 #include "Matrix/Matrix3D.hpp"
 #include "Matrix/Matrix4D.hpp"
+#include "Utility/PackedSequenceSet.hpp"
 
 
+/*!
+ * \brief The EMSequenceEngine class classifies DNA sequences using an
+ * expectation-maximization procedure. The E-step is computed in log
+ * space.
+ * \tparam T the type used to store the sequence log likelihoods and
+ * posterior probabilities, float or double. The computations are
+ * always done in double precision, float halves the memory used by
+ * the largest data structures.
+ */
+template<class T>
 class EMSequenceEngine : public ClusteringEngine
 {
     public:
@@ -37,7 +53,9 @@ class EMSequenceEngine : public ClusteringEngine
          * renormalized at iteration to make the density fit a gaussian
          * centered on the most central shift state.
          * \param seed a sequence to initialise the random number generator.
-         * \param seeding the seeding method to use among : "random".
+         * \param seeding the seeding method to use among : "random", "kmer".
+         * \param n_threads the number of threads to use to run the
+         * E-step. At least 1.
          * \throw std::invalid_argument if one of the given argument has
          * a wrong value.
          */
@@ -48,7 +66,42 @@ class EMSequenceEngine : public ClusteringEngine
                          bool center_shift,
                          bool bg_class,
                          const std::string& seed,
-                         const std::string& seeding) throw (std::invalid_argument);
+                         const std::string& seeding,
+                         size_t n_threads=1) throw (std::invalid_argument);
+
+        /*!
+         * \brief Constructs an instance to classify the given sequences,
+         * as above, without copying them. The sequences are only read
+         * such that a same set can be shared by several instances, for
+         * instance classifying the sequences concurrently from different
+         * random starting points.
+         * \param sequences the sequence to classify, already encoded.
+         * \param n_class the number of classes to discover. At least 1.
+         * \param l_motif the motif length in bp.
+         * \param flip whether the reverse complement strand should also
+         * be used for classification.
+         * \param center_shift hether the shift probabilities should be
+         * renormalized at iteration to make the density fit a gaussian
+         * centered on the most central shift state.
+         * \param bg_class whether an extra class modelling the background
+         * should be added.
+         * \param seed a sequence to initialise the random number generator
+         * of this instance.
+         * \param seeding the seeding method to use among : "random", "kmer".
+         * \param n_threads the number of threads to use to run the
+         * E-step. At least 1.
+         * \throw std::invalid_argument if one of the given argument has
+         * a wrong value.
+         */
+        EMSequenceEngine(std::shared_ptr<const PackedSequenceSet> sequences,
+                         size_t n_class,
+                         size_t l_motif,
+                         bool flip,
+                         bool center_shift,
+                         bool bg_class,
+                         const std::string& seed,
+                         const std::string& seeding,
+                         size_t n_threads=1) throw (std::invalid_argument);
 
         /*!
          * \brief Constructs an instance to classifiy the given sequnces
@@ -64,6 +117,8 @@ class EMSequenceEngine : public ClusteringEngine
          * centered on the most central shift state.
          * \param bg_class whether an extra class modelling the background
          * should be added.
+         * \param n_threads the number of threads to use to run the
+         * E-step. At least 1.
          * \throw std::invalid_argument if one of the given argument has
          * a wrong value.
          */
@@ -71,7 +126,59 @@ class EMSequenceEngine : public ClusteringEngine
                          const std::vector<Matrix2D<double>>& motifs,
                          bool flip,
                          bool center_shift,
-                         bool bg_class) throw (std::invalid_argument);
+                         bool bg_class,
+                         size_t n_threads=1) throw (std::invalid_argument);
+
+        /*!
+         * \brief Constructs an instance to classifiy the given sequnces
+         * using the given motif as starting point, as above, without
+         * copying the sequences. The sequences are only read such that
+         * a same set can be shared by several instances.
+         * \param sequences the sequence to classify, already encoded.
+         * \param motifs a vector containing the motif to use as starting
+         * point and to optimize. The number of motif determines the
+         * number of classes.
+         * \param flip whether the reverse complement strand should also
+         * be used for classification.
+         * \param center_shift hether the shift probabilities should be
+         * renormalized at iteration to make the density fit a gaussian
+         * centered on the most central shift state.
+         * \param bg_class whether an extra class modelling the background
+         * should be added.
+         * \param n_threads the number of threads to use to run the
+         * E-step. At least 1.
+         * \throw std::invalid_argument if one of the given argument has
+         * a wrong value.
+         */
+        EMSequenceEngine(std::shared_ptr<const PackedSequenceSet> sequences,
+                         const std::vector<Matrix2D<double>>& motifs,
+                         bool flip,
+                         bool center_shift,
+                         bool bg_class,
+                         size_t n_threads=1) throw (std::invalid_argument);
+
+        /*!
+         * \brief Constructs an instance to classify the given sequences,
+         * resuming the classification saved in a checkpoint file (see
+         * write_checkpoint()). The model, the settings and the iteration
+         * counter are restored such that no seeding is run. The posterior
+         * probabilities are not saved, they are computed again by the
+         * next call to cluster(), which thus cannot report a convergence.
+         * In sparse mode, the states kept are not saved either, all the
+         * states are kept until the next full rescoring.
+         * \param sequences the sequence to classify, already encoded. They
+         * should be the ones used when the checkpoint was written.
+         * \param checkpoint the address of the checkpoint file.
+         * \param n_threads the number of threads to use to run the
+         * E-step. At least 1.
+         * \throw std::invalid_argument if the number of threads is 0 or if
+         * the checkpoint does not match the sequences or the type T.
+         * \throw std::runtime_error if the checkpoint cannot be read or is
+         * not a valid checkpoint.
+         */
+        EMSequenceEngine(std::shared_ptr<const PackedSequenceSet> sequences,
+                         const std::string& checkpoint,
+                         size_t n_threads=1) throw (std::invalid_argument, std::runtime_error);
 
         /*!
          * \brief Destructor.
@@ -83,7 +190,9 @@ class EMSequenceEngine : public ClusteringEngine
          * \brief Runs one iteration of optimization, that is
          * the sequence are scored with the current motifs and
          * are assigned to the classes (E-step) and the motifs
-         * are updated accordingly.
+         * are updated accordingly. With the SQUAREM acceleration,
+         * an iteration runs 3 (or 4) EM steps, see
+         * set_acceleration().
          * \return a constant indicating what to do next :
          * in case of convergence nothing more to do as the
          * solution is stable, in case of success other calls
@@ -98,6 +207,235 @@ class EMSequenceEngine : public ClusteringEngine
          */
         void seeding(const std::string& method) throw (std::runtime_error) override ;
 
+        /*!
+         * \brief Sets whether the fused mode is used. In fused mode,
+         * each call to cluster() runs the E-step and the M-step in a
+         * single pass over the sequences : each sequence is scored,
+         * its posterior probabilities are computed and are immediately
+         * added to the class probability and motif base counts. The
+         * sequence likelihoods are never stored, which saves one
+         * sequences x classes x shifts x flips matrix. The fused mode
+         * is off by default.
+         * \param fused whether the fused mode should be used.
+         */
+        void set_fused(bool fused) ;
+
+        /*!
+         * \brief Sets the method used to accelerate the convergence.
+         * With "none", the default, each call to cluster() runs one EM
+         * step. With "squarem", each call to cluster() runs a SQUAREM
+         * cycle (Varadhan and Roland, 2008) : two EM steps are run from
+         * the current parameters (motifs and class probabilities), the
+         * parameters are extrapolated along the path of these two steps
+         * and a third EM step is run from the extrapolated parameters.
+         * If the extrapolated parameters have a lower log likelihood
+         * than the parameters after the first EM step, they are
+         * rejected and a regular EM step is run instead, from the
+         * parameters after the second step.
+         * \param method the acceleration method, "none" or "squarem".
+         * \throw std::invalid_argument if the method is not recognized.
+         */
+        void set_acceleration(const std::string& method) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Sets the sparse mode. In sparse mode, the posterior
+         * probabilities are stored, for each sequence, as a list of the
+         * (class, shift, flip) states which are kept, with their
+         * probabilities. Every Constants::sparse_period E-steps, starting
+         * with the first one, all the states are scored and only the
+         * smallest set of most likely states holding 1-threshold of the
+         * posterior probability mass is kept. In between, only the kept
+         * states are scored and the posterior probabilities are
+         * normalized over them. The M-step only iterates over the kept
+         * states and the convergence is only checked after a full
+         * rescoring. Turning the sparse mode on frees the dense
+         * posterior probabilities, the first full rescoring building
+         * the lists from scratch, such that the classification cannot
+         * converge at the first E-step. The sparse mode is not used
+         * by cluster_batch() and update_post_prob() and supersedes the
+         * fused mode.
+         * \param threshold the posterior probability mass which can be
+         * pruned, 0 turns the sparse mode off (the default).
+         * \throw std::invalid_argument if the threshold is not in
+         * [0,1).
+         */
+        void set_sparse(double threshold) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Sets a band of shift states outside of which the
+         * shifts are neither scored nor stored, the sequence likelihood
+         * and posterior probability matrices being sized to the band.
+         * The band spans the shifts within the given window around the
+         * central shift and, if a threshold is given, is further
+         * narrowed down before each EM step to the smallest range of
+         * shifts containing all the shifts which prior probability
+         * (the class probabilities summed over the classes and flip
+         * states) is at least the threshold. The most likely shift is
+         * always part of the band. The shifts outside the band get a
+         * null class probability at the next M-step, unless the shifts
+         * are centered (see center_shifts()) and the band can then grow
+         * again. By default, the band spans all the shifts. The band
+         * cannot be used in sparse mode.
+         * \param window the number of shifts on each side of the
+         * central shift which are part of the band, values equal to or
+         * larger than the number of shifts lift the limit.
+         * \param threshold the minimal prior probability of the shifts
+         * at the band edges, 0 to only use the window.
+         * \throw std::invalid_argument if the threshold is not in [0,1)
+         * or if the sparse mode is on.
+         */
+        void set_shift_band(size_t window, double threshold) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Sets the incremental mode. In incremental mode, the
+         * E-step is only run on the active sequences, the other ones
+         * being frozen. The contribution of each sequence to the
+         * sufficient statistics (the posterior probability sums and the
+         * motif base counts) is cached and the change of the
+         * contribution of each active sequence is added to the cache,
+         * from which the M-step is run. Every
+         * Constants::incremental_period E-steps at most, a full sweep
+         * scores all the sequences again, rebuilds the cache from
+         * scratch and sets the active sequences to the ones which
+         * posterior probabilities changed by more than the threshold.
+         * After each E-step, the active sequences which posterior
+         * probabilities changed by at most the threshold are frozen.
+         * Once all the sequences are frozen, the next E-step is a full
+         * sweep. Convergence can only be reached after a full sweep.
+         * The log likelihood of a frozen sequence is the one computed
+         * the last time it was scored. The sequence likelihoods are not
+         * stored. The incremental mode is not used by cluster_batch()
+         * and update_post_prob() and supersedes the fused mode.
+         * \param threshold the largest posterior probability change
+         * under which a sequence is frozen, 0 turns the incremental
+         * mode off (the default).
+         * \throw std::invalid_argument if the threshold is not in [0,1)
+         * or if the sparse mode is on.
+         */
+        void set_incremental(double threshold) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Sets the hard assignment mode (classification EM). In
+         * hard mode, the E-step assigns each sequence to its most likely
+         * (class, shift, flip) state, ties being broken in favour of the
+         * first state, and only this assignment is stored. The M-step
+         * counts, using integers, the sequences assigned to each state
+         * and the bases of the corresponding sub-sequences. As in the
+         * regular mode, each state otherwise has a posterior probability
+         * of Constants::pseudo_counts, which is accounted for in the
+         * class probabilities. The largest posterior probability change
+         * is 1 if an assignment changed and 0 otherwise, such that the
+         * procedure converges to an exact fixed point. The data log
+         * likelihood is the classification log likelihood, that is
+         * the sum, over the sequences, of the log joint probability of
+         * the sequence and of its state. The initial assignments are the
+         * most likely states given the posterior probabilities computed
+         * by the seeding, which are freed afterwards. The hard mode is
+         * not used by cluster_batch() and update_post_prob() and
+         * supersedes the fused mode.
+         * \param hard whether the hard mode should be used.
+         * \throw std::invalid_argument if the sparse or the incremental
+         * mode is on.
+         */
+        void set_hard(bool hard) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Sets the rule used to decide whether cluster() converged.
+         * With Constants::POST_PROB_DELTA, the default, convergence is
+         * reached when no posterior probability changed by more than
+         * Constants::delta_max during the last E-step. With
+         * Constants::LOG_LIKELIHOOD, convergence is reached when the
+         * relative change of the data log likelihood between the last
+         * two E-steps is at most the given tolerance. With
+         * Constants::BOTH, both conditions should be met.
+         * \param rule the stopping rule.
+         * \param tolerance the relative log likelihood tolerance.
+         * \throw std::invalid_argument if the tolerance is negative.
+         */
+        void set_stopping_rule(Constants::stopping_rules rule,
+                               double tolerance) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Replaces the sequences by the given ones, for instance
+         * the next mini-batch of a stepwise EM (see cluster_batch()).
+         * The model (the motifs, the class and background probabilities)
+         * is kept, the data structures holding per sequence values are
+         * resized to the new number of sequences and their content is
+         * undefined until the next E-step.
+         * \param sequences the new sequences, one per row. They should
+         * have the same length as the current ones.
+         * \throw std::invalid_argument if the sequences do not have the
+         * right length or if there is no sequence.
+         */
+        void set_sequences(const Matrix2D<char>& sequences) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Sets the base background probabilities, which are
+         * otherwise computed from the sequences given at construction.
+         * The background class motif, if any, is updated accordingly.
+         * \param bg_prob the probabilities of A, C, G and T.
+         * \throw std::invalid_argument if bg_prob does not contain 4
+         * values.
+         */
+        void set_background_prob(const std::vector<double>& bg_prob) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Sets the class probabilities, for instance those of an
+         * instance trained on a subset of the sequences, which are used
+         * as priors by the next E-step. The values below
+         * Constants::pseudo_counts are raised to it and the
+         * probabilities are normalized.
+         * \param class_prob the class probabilities, with the dimensions
+         * of get_class_prob().
+         * \throw std::invalid_argument if the dimensions do not match the
+         * model.
+         */
+        void set_class_prob(const Matrix3D<double>& class_prob) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Sets the prefix sums of the log background probabilities
+         * of the bases of each sequence, from which the background log
+         * likelihood of any sub-sequence is computed as the difference of
+         * two values (see dna::background_log_prefix()). These values do
+         * not depend on the motif length such that a same table can be
+         * shared by instances using different motif lengths, instead of
+         * being computed by each of them. The background class
+         * likelihoods are computed again from it and it is used from then
+         * on to compute the full sequence log likelihood (see
+         * compute_sequence_log_likelihood()).
+         * \param prefix the prefix sums, computed from the sequences and the
+         * background probabilities of this instance, on both strands if the
+         * reverse complement strand is used.
+         * \throw std::invalid_argument if the table dimensions do not match
+         * the sequences.
+         */
+        void set_background_log_prefix(std::shared_ptr<const Matrix3D<double>> prefix) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Runs one iteration of stepwise (online) EM on the
+         * current sequences, considered as a mini-batch of a larger data
+         * set (Cappe and Moulines, 2009). The posterior probabilities of
+         * the batch are computed (E-step, the fused mode is not used as
+         * the batch data structures are small) and the running
+         * sufficient statistics, that is the posterior probability sums
+         * and the motif base counts per sequence, are moved towards those
+         * of the batch : s = (1 - step_size) * s + step_size * s_batch.
+         * The motifs and class probabilities are then updated from the
+         * running statistics (M-step).
+         * \param step_size the weight of the batch statistics, in (0,1].
+         * With 1, the previous statistics are discarded, this should be
+         * the case at the first call.
+         * \throw std::invalid_argument if the step size is out of range.
+         */
+        void cluster_batch(double step_size) throw (std::invalid_argument) ;
+
+        /*!
+         * \brief Runs the E-step only, that is computes the posterior
+         * probabilities and the log likelihoods of the current sequences
+         * given the current model, which is left unchanged.
+         */
+        void update_post_prob() ;
+
         /*!
          * \brief Returns the motifs.
          * \return a vector containing the motifs.
@@ -105,11 +443,13 @@ class EMSequenceEngine : public ClusteringEngine
         std::vector<Matrix2D<double>> get_motifs() const ;
 
         /*!
-         * \brief Returns the posterior probabilities.
+         * \brief Returns the posterior probabilities. In sparse
+         * mode, the pruned states have a probability equal to
+         * Constants::pseudo_counts.
          * \return a matrix containing the posterior
          * probabilities.
          */
-        Matrix4D<double> get_post_prob() const ;
+        Matrix4D<T> get_post_prob() const ;
 
         /*!
          * \brief Returns the class probabilities.
@@ -126,6 +466,61 @@ class EMSequenceEngine : public ClusteringEngine
          */
         std::vector<double> get_class_prob_total() const ;
 
+        /*!
+         * \brief Returns the data log likelihood computed during the
+         * last E-step, that is given the model before the last call to
+         * cluster() updated it.
+         * \return the data log likelihood.
+         */
+        double get_log_likelihood() const ;
+
+        /*!
+         * \brief Computes the data log likelihood of the full sequences
+         * given the current model : each sequence is modelled by the motif
+         * of a class over the sub-sequence at a given shift and strand and
+         * by the background probabilities over the other bases (read on
+         * the same strand). Unlike get_log_likelihood(), which only
+         * accounts for the sub-sequences scored by the motifs, this value
+         * does not depend on the motif length such that models using
+         * different motif lengths can be compared. All the shifts are
+         * scored, whatever the mode.
+         * \return the data log likelihood.
+         */
+        double compute_sequence_log_likelihood() const ;
+
+        /*!
+         * \brief Returns the largest absolute change of a posterior
+         * probability during the last E-step.
+         * \return the largest posterior probability change.
+         */
+        double get_post_prob_delta() const ;
+
+        /*!
+         * \brief Returns the number of iterations run so far, including
+         * the ones run before the checkpoint this instance was restored
+         * from, if any.
+         * \return the number of iterations.
+         */
+        size_t get_n_iter() const ;
+
+        /*!
+         * \brief Writes the current state to a binary checkpoint file
+         * from which the classification can be resumed (see the
+         * corresponding constructor) : the model dimensions and settings,
+         * the iteration and sparse E-step counters, the motifs, the class
+         * probabilities, the background probabilities, the last log
+         * likelihoods and the random number generator state. The per sequence data (the
+         * likelihoods and the posterior probabilities) are not written
+         * such that the file size does not depend on the number of
+         * sequences. The values are written in the native byte order.
+         * The file is first written under a temporary name and then
+         * renamed, such that an existing checkpoint is only replaced by
+         * a complete one.
+         * \param checkpoint the address of the checkpoint file.
+         * \throw std::runtime_error if the file cannot be written.
+         */
+        void write_checkpoint(const std::string& checkpoint) const throw (std::runtime_error) ;
+
         /*!
          * \brief Prints the motifs to the given stream.
          * \param stream the ouput stream of interest.
@@ -141,6 +536,47 @@ class EMSequenceEngine : public ClusteringEngine
          */
         bool hasConverged() const override ;
 
+        /*!
+         * \brief Restores the state written by write_checkpoint()
+         * and allocates the data structures accordingly. The
+         * posterior probabilities are set as equally likely.
+         * \param checkpoint the address of the checkpoint file.
+         * \throw std::invalid_argument if the checkpoint does not
+         * match the sequences or the type T.
+         * \throw std::runtime_error if the checkpoint cannot be read
+         * or is not a valid checkpoint.
+         */
+        void read_checkpoint(const std::string& checkpoint) throw (std::invalid_argument, std::runtime_error) ;
+
+        /*!
+         * \brief Runs one EM step : the E-step, the M-step, the motif
+         * normalisation and, if needed, the shift centering.
+         */
+        void em_step() ;
+
+        /*!
+         * \brief Runs one SQUAREM cycle, see set_acceleration().
+         */
+        void squarem_step() ;
+
+        /*!
+         * \brief Gets the model parameters as a flat vector : the
+         * trained motifs (class, base, position) followed by the class
+         * probabilities (class, shift, flip).
+         * \return the model parameters.
+         */
+        std::vector<double> get_parameters() const ;
+
+        /*!
+         * \brief Sets the model parameters from a flat vector, as
+         * returned by get_parameters(). The values are projected back
+         * into the parameter space : values below the pseudo count are
+         * raised to it, the motif columns and the class probabilities
+         * are normalized.
+         * \param parameters the model parameters.
+         */
+        void set_parameters(const std::vector<double>& parameters) ;
+
         /*!
          * \brief Adds an extra motif initialise to the current
          * background probabilities. Updates the number of classes
@@ -148,12 +584,96 @@ class EMSequenceEngine : public ClusteringEngine
          */
         void add_background_class() ;
 
+        /*!
+         * \brief Computes the log likelihood of the sequences given the
+         * background class, for each shift and flip state, and stores
+         * it in _bg_likelihood. The log likelihood of each window is
+         * obtained in constant time from per-sequence prefix sums of the
+         * log background probabilities.
+         */
+        void compute_bg_likelihood() ;
+
+        /*!
+         * \brief Allocates the sequence likelihood matrix, before an
+         * E-step storing them. The matrix is only stored in the default
+         * mode (none of the fused, sparse, incremental and hard modes
+         * is used) and is left untouched if it already has the
+         * dimensions of the current shift band.
+         */
+        void allocate_likelihood() ;
+
+        /*!
+         * \brief Gets the prefix sums of the log background probabilities
+         * of the bases of a sequence, from the shared table if any, or
+         * computes them.
+         * \param seq_index the index of the sequence of interest.
+         * \param prefix a vector of sequence length + 1 values in which the
+         * prefix sums of the bases are written.
+         * \param prefix_rev a vector of sequence length + 1 values in which
+         * the prefix sums of the complement bases are written, if the
+         * reverse complement strand is used.
+         */
+        void get_bg_log_prefix(size_t seq_index,
+                               std::vector<double>& prefix,
+                               std::vector<double>& prefix_rev) const ;
+
+        /*!
+         * \brief The routine computing the full sequence log likelihoods
+         * of a range of sequences, see compute_sequence_log_likelihood().
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param motifs_log the interleaved log motifs of the trained
+         * classes, as returned by compute_motifs_log().
+         * \param class_prob_log the log class probabilities.
+         * \return the sum of the sequence log likelihoods.
+         */
+        double compute_sequence_log_likelihood_routine(size_t from, size_t to,
+                                                       const std::vector<double>& motifs_log,
+                                                       const Matrix3D<double>& class_prob_log) const ;
+
         /*!
          * \brief Sets the poterior probabilities at random using a beta
          * distribution and updates the class probabilities.
          */
         void seeding_random() ;
 
+        /*!
+         * \brief Seeds the motifs with the most over-represented k-mers
+         * (k being the motif length, at most Constants::kmer_length).
+         * The k-mers are counted in a single pass over the sequences,
+         * on both strands if flip is enabled. They are ranked by the
+         * z-score of their count given the background model and the
+         * best ones are picked greedily, skipping those similar to a
+         * k-mer already picked (or to its reverse complement if flip is
+         * enabled), that is those matching it with at most k/8
+         * mismatches, shifted by at most k/4 positions. Each motif is
+         * the background model in which the k-mer columns, centered,
+         * are mixed with the k-mer using a weight of
+         * Constants::kmer_weight. The posterior probabilities are then
+         * computed as with compute_initial_post_prob().
+         */
+        void seeding_kmer() ;
+
+        /*!
+         * \brief Computes the likelihood given the current motifs and
+         * sets the posterior probabilities proportional to it, without
+         * accounting for the class probabilities, and updates the class
+         * probabilities. The likelihood are not stored.
+         */
+        void compute_initial_post_prob() ;
+
+        /*!
+         * \brief The routine computing the initial posterior
+         * probabilities of the sequences [from,to) given the current
+         * motifs.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param motifs_log the interleaved log motifs, as returned by
+         * compute_motifs_log().
+         */
+        void compute_initial_post_prob_routine(size_t from, size_t to,
+                                               const std::vector<double>& motifs_log) ;
+
         /*!
          * \brief Modifies the class probabilities in such a way that the
          * shift probabilities are then normaly distributed, centered on
@@ -168,6 +688,65 @@ class EMSequenceEngine : public ClusteringEngine
          */
         void compute_class_prob() ;
 
+        /*!
+         * \brief Sums the current posterior probabilities over the
+         * sequences, for each class, shift and flip state.
+         * \return the posterior probability sums.
+         */
+        Matrix3D<double> compute_post_prob_sum() const ;
+
+        /*!
+         * \brief The routine summing the posterior probabilities of the
+         * sequences [from,to) over the sequences, for each class, shift
+         * and flip state.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param class_prob a matrix, initialised to 0, to add the sums
+         * to.
+         */
+        void compute_class_prob_routine(size_t from, size_t to,
+                                        Matrix3D<double>& class_prob) const ;
+
+        /*!
+         * \brief The hard mode counterpart of
+         * compute_class_prob_routine(), counting the sequences
+         * assigned to each state.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param class_prob a matrix, initialised to 0, to add the sums
+         * to.
+         */
+        void compute_class_prob_hard_routine(size_t from, size_t to,
+                                             Matrix3D<double>& class_prob) const ;
+
+        /*!
+         * \brief The sparse mode counterpart of
+         * compute_class_prob_routine(), iterating over the kept
+         * states only.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param class_prob a matrix, initialised to 0, to add the sums
+         * to.
+         */
+        void compute_class_prob_sparse_routine(size_t from, size_t to,
+                                               Matrix3D<double>& class_prob) const ;
+
+        /*!
+         * \brief Merges the partial posterior probability sums computed
+         * by compute_class_prob_routine() over different slices.
+         * \param partials the partial sums, one per slice. The total is
+         * stored in partials[0].
+         */
+        void reduce_class_prob(std::vector<Matrix3D<double>>& partials) const ;
+
+        /*!
+         * \brief Sets the class probabilities from the sums, over all
+         * the sequences, of the posterior probabilities.
+         * \param post_prob_sum the posterior probability sums, for each
+         * class, shift and flip state.
+         */
+        void update_class_prob(const Matrix3D<double>& post_prob_sum) ;
+
         /*!
          * \brief Computes the motif according to the current posterior
          * probabilities and class probabilities.
@@ -175,17 +754,336 @@ class EMSequenceEngine : public ClusteringEngine
         void compute_motifs() ;
 
         /*!
-         * \brief Computes the sequence likelihood (that is, the probability
-         * of the sequences given the current motifs).
+         * \brief Computes the base counts of each trained class motif,
+         * weighted by the current posterior probabilities.
+         * \return the base counts, one 4 x motif length matrix per
+         * trained class.
+         */
+        std::vector<Matrix2D<double>> compute_motif_counts() const ;
+
+        /*!
+         * \brief The routine computing the base counts of each trained
+         * class motif, weighted by the posterior probabilities, over the
+         * sequences [from,to).
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param counts a vector of 4 x motif length matrices, one per
+         * trained class, initialised to 0, to add the counts to.
+         */
+        void compute_motifs_routine(size_t from, size_t to,
+                                    std::vector<Matrix2D<double>>& counts) const ;
+
+        /*!
+         * \brief The hard mode counterpart of compute_motifs_routine(),
+         * counting the bases of the sub-sequences assigned to each
+         * state.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param counts a vector of 4 x motif length matrices, one per
+         * trained class, initialised to 0, to add the counts to.
+         */
+        void compute_motifs_hard_routine(size_t from, size_t to,
+                                         std::vector<Matrix2D<double>>& counts) const ;
+
+        /*!
+         * \brief The sparse mode counterpart of compute_motifs_routine(),
+         * iterating over the kept states only.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param counts a vector of 4 x motif length matrices, one per
+         * trained class, initialised to 0, to add the counts to.
+         */
+        void compute_motifs_sparse_routine(size_t from, size_t to,
+                                           std::vector<Matrix2D<double>>& counts) const ;
+
+        /*!
+         * \brief Merges the partial base counts computed by
+         * compute_motifs_routine() over different slices.
+         * \param partials the partial counts, one vector per slice. The
+         * total is stored in partials[0].
+         */
+        void reduce_motif_counts(std::vector<std::vector<Matrix2D<double>>>& partials) const ;
+
+        /*!
+         * \brief Sets the trained class motifs from their base counts,
+         * adding pseudo counts and normalizing the columns.
+         * \param counts the base counts, one 4 x motif length matrix
+         * per trained class.
+         */
+        void update_motifs(const std::vector<Matrix2D<double>>& counts) ;
+
+        /*!
+         * \brief Computes the log motif of each class and, if the reverse
+         * complement strand is used, of its reverse complement, all
+         * interleaved in the format used by
+         * dna::score_all_shifts_all_motifs(). The motif of class k and
+         * flip state f has index k*_n_flip + f.
+         * \return the interleaved log motifs.
+         */
+        std::vector<double> compute_motifs_log() const ;
+
+        /*!
+         * \brief Computes the sequence log likelihood (that is, the log
+         * probability of the sequences given the current motifs).
          */
         void compute_likelihood() ;
 
+        /*!
+         * \brief The routine computing the log likelihood of the sequences
+         * [from,to) given the current motifs.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param motifs_log the interleaved log motifs, as returned by
+         * compute_motifs_log().
+         */
+        void compute_likelihood_routine(size_t from, size_t to,
+                                        const std::vector<double>& motifs_log) ;
+
         /*!
          * \brief Computes the posterior probability of each sequence to
-         * belong to each class, for each shift and flip state.
+         * belong to each class, for each shift and flip state. The
+         * probabilities are normalized in log space, using a
+         * max-subtracted log-sum-exp. The largest change of a posterior
+         * probability is stored in _post_prob_delta and the data log
+         * likelihood in _log_likelihood.
          */
         void compute_posterior_prob() ;
 
+        /*!
+         * \brief The routine computing the posterior probabilities of
+         * the sequences [from,to).
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param class_prob_log the log class probabilities.
+         * \return the largest absolute change of a posterior probability
+         * of these sequences.
+         */
+        double compute_posterior_prob_routine(size_t from, size_t to,
+                                              const Matrix3D<double>& class_prob_log) ;
+
+        /*!
+         * \brief Computes the posterior probabilities in sparse mode,
+         * see set_sparse(). The largest change of a posterior
+         * probability is stored in _post_prob_delta and the data log
+         * likelihood in _log_likelihood. Between two full rescorings,
+         * the sequence likelihoods are summed over the kept states only
+         * and divided by the mass these states had at the last full
+         * rescoring, which accounts for the pruned states.
+         */
+        void compute_posterior_prob_sparse() ;
+
+        /*!
+         * \brief The routine computing the posterior probabilities of
+         * the sequences [from,to) in sparse mode.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param motifs_log the interleaved log motifs, as returned by
+         * compute_motifs_log().
+         * \param class_prob_log the log class probabilities.
+         * \param rescore whether all the states should be scored, and
+         * the kept states selected again, or only the kept states.
+         * \return the largest absolute change of a posterior probability
+         * of these sequences, the pruned states being considered equal
+         * to Constants::pseudo_counts.
+         */
+        double compute_posterior_prob_sparse_routine(size_t from, size_t to,
+                                                     const std::vector<double>& motifs_log,
+                                                     const Matrix3D<double>& class_prob_log,
+                                                     bool rescore) ;
+
+        /*!
+         * \brief Computes the most likely state of each sequence in
+         * hard mode, see set_hard(). The largest change of a posterior
+         * probability is stored in _post_prob_delta and the data log
+         * likelihood in _log_likelihood.
+         */
+        void compute_assignment() ;
+
+        /*!
+         * \brief The routine computing the most likely state of the
+         * sequences [from,to) in hard mode.
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param motifs_log the interleaved log motifs, as returned by
+         * compute_motifs_log().
+         * \param class_prob_log the log class probabilities.
+         * \return the number of sequences which state changed.
+         */
+        size_t compute_assignment_routine(size_t from, size_t to,
+                                          const std::vector<double>& motifs_log,
+                                          const Matrix3D<double>& class_prob_log) ;
+
+        /*!
+         * \brief Gets the class, shift and flip state corresponding to
+         * a state index of the sparse posterior probabilities.
+         * \param state the state index, (k*_n_shift + s)*_n_flip + f.
+         * \param k the class index.
+         * \param s the shift index.
+         * \param f the flip index.
+         */
+        void decode_state(size_t state, size_t& k, size_t& s, size_t& f) const ;
+
+        /*!
+         * \brief Builds the posterior probability matrix from the
+         * sparse posterior probabilities, the pruned states being set
+         * to Constants::pseudo_counts.
+         * \return the posterior probabilities.
+         */
+        Matrix4D<T> unpack_post_prob() const ;
+
+        /*!
+         * \brief Builds the posterior probability matrix from the
+         * hard assignments, the state of each sequence having a
+         * probability of 1 and the other ones
+         * Constants::pseudo_counts.
+         * \return the posterior probabilities.
+         */
+        Matrix4D<T> unpack_assignment() const ;
+
+        /*!
+         * \brief Computes the log of the class probabilities.
+         * \return the log class probabilities.
+         */
+        Matrix3D<double> compute_class_prob_log() const ;
+
+        /*!
+         * \brief Converts a posterior probability to the storage
+         * type. Values equal to 0, including values which
+         * underflow in T, are replaced by a pseudo count such that
+         * a posterior probability is never 0.
+         * \param prob the posterior probability.
+         * \return the value to store.
+         */
+        static T to_post_prob(double prob) ;
+
+        /*!
+         * \brief Runs the E-step and the M-step in a single pass over
+         * the sequences, without storing the likelihoods. This updates
+         * the posterior probabilities, the class probabilities and the
+         * motifs (which still have to be normalised), as well as
+         * _post_prob_delta and _log_likelihood.
+         */
+        void compute_em_fused() ;
+
+        /*!
+         * \brief Runs the E-step on the active sequences, or on all the
+         * sequences in case of full sweep, and the M-step from the
+         * cached sufficient statistics, see set_incremental(). This
+         * updates the posterior probabilities, the class probabilities
+         * and the motifs (which still have to be normalised), as well
+         * as _post_prob_delta and _log_likelihood.
+         */
+        void compute_em_incremental() ;
+
+        /*!
+         * \brief The routine of compute_em_incremental() processing the
+         * sequences _active_seq[from,to).
+         * \param from the index, in _active_seq, of the first sequence
+         * to process.
+         * \param to the index, in _active_seq, of the past last sequence
+         * to process.
+         * \param motifs_log the interleaved log motifs, as returned by
+         * compute_motifs_log().
+         * \param class_prob_log the log class probabilities.
+         * \param full whether this is a full sweep, in which case the
+         * contributions of the sequences are added to the sums and base
+         * counts, otherwise the changes of the contributions are.
+         * \param class_prob a matrix, initialised to 0, to add the
+         * posterior probability sums to.
+         * \param counts a vector of 4 x motif length matrices, one per
+         * trained class, initialised to 0, to add the base counts to.
+         * \return the largest absolute change of a posterior probability
+         * of these sequences.
+         */
+        double compute_em_incremental_routine(size_t from, size_t to,
+                                              const std::vector<double>& motifs_log,
+                                              const Matrix3D<double>& class_prob_log,
+                                              bool full,
+                                              Matrix3D<double>& class_prob,
+                                              std::vector<Matrix2D<double>>& counts) ;
+
+        /*!
+         * \brief Sums the per sequence log likelihoods of the last E-step,
+         * in the sequence order, into _log_likelihood. The previous value
+         * is kept in _log_likelihood_prev.
+         */
+        void update_log_likelihood() ;
+
+        /*!
+         * \brief The routine of compute_em_fused() processing the
+         * sequences [from,to).
+         * \param from the index of the first sequence to process.
+         * \param to the index of the past last sequence to process.
+         * \param motifs_log the interleaved log motifs, as returned by
+         * compute_motifs_log().
+         * \param class_prob_log the log class probabilities.
+         * \param class_prob a matrix, initialised to 0, to add the
+         * posterior probability sums to.
+         * \param counts a vector of 4 x motif length matrices, one per
+         * trained class, initialised to 0, to add the base counts to.
+         * \return the largest absolute change of a posterior probability
+         * of these sequences.
+         */
+        double compute_em_fused_routine(size_t from, size_t to,
+                                        const std::vector<double>& motifs_log,
+                                        const Matrix3D<double>& class_prob_log,
+                                        Matrix3D<double>& class_prob,
+                                        std::vector<Matrix2D<double>>& counts) ;
+
+        /*!
+         * \brief Updates the shift band, see set_shift_band(), given
+         * the current class probabilities. If the band changes, the
+         * posterior probabilities are moved to the new band, the shifts
+         * entering it being set to Constants::pseudo_counts.
+         */
+        void update_shift_band() ;
+
+        /*!
+         * \brief Splits the sequences into chunks of consecutive
+         * sequences and runs the given routine on each of them.
+         * The chunks are sized such that the part of the data
+         * structures spanned by a chunk fits in cache (see
+         * Constants::chunk_size) and are dispatched over
+         * this->_n_threads threads. The given routine should only
+         * write data belonging to the sequences of its chunk,
+         * such that the results do not depend on the number of
+         * threads.
+         * \param routine the routine to run, it takes the index of
+         * the first and of the past last sequences of the chunk.
+         */
+        void run_on_chunks(const std::function<void(size_t,size_t)>& routine) const ;
+
+        /*!
+         * \brief Gets the number of slices used by run_on_slices().
+         * \return the number of slices, that is the number of threads
+         * or the number of sequences if there are fewer sequences.
+         */
+        size_t get_slice_number() const ;
+
+        /*!
+         * \brief Splits the sequences into get_slice_number() slices of
+         * consecutive sequences and runs the given routine once per
+         * slice, one slice per thread. This is meant for reductions
+         * over the sequences : each slice accumulates its own partial
+         * result which are then merged using tree_reduce(). For a given
+         * number of threads, the results are deterministic.
+         * \param routine the routine to run, it takes the index of the
+         * slice and the index of the first and of the past last
+         * sequences of the slice.
+         */
+        void run_on_slices(const std::function<void(size_t,size_t,size_t)>& routine) const ;
+
+        /*!
+         * \brief Same as run_on_slices() but splits the range [0,n),
+         * for instance the indices of a subset of the sequences, into
+         * get_slice_number() slices, some of which may be empty.
+         * \param n the size of the range.
+         * \param routine the routine to run, it takes the index of the
+         * slice and the first and past last values of the slice.
+         */
+        void run_on_slices(size_t n,
+                           const std::function<void(size_t,size_t,size_t)>& routine) const ;
+
         /*!
          * \brief Normalizes the motifs according the their own
          * base composition. For each motif (but an eventual background
@@ -205,9 +1103,10 @@ class EMSequenceEngine : public ClusteringEngine
 
         // fields
         /*!
-         * \brief the sequences (on each row).
+         * \brief the sequences, encoded once and possibly shared with
+         * other instances.
          */
-        Matrix2D<char> _sequences ;
+        std::shared_ptr<const PackedSequenceSet> _sequences ;
         /*!
          * \brief a vector containing each class motif.
          */
@@ -228,22 +1127,66 @@ class EMSequenceEngine : public ClusteringEngine
         std::vector<double> _class_prob_tot ;
         /*!
          * \brief the sequence posterior probabilities to belong
-         * to each of the classes.
+         * to each of the classes, over the shift band.
          */
-        Matrix4D<double> _post_prob ;
+        Matrix4D<T> _post_prob ;
         /*!
-         * \brief the sequence posterior probabilities to belong
-         * to each of the classes at the previous iteration.
+         * \brief the running posterior probability sums, per
+         * sequence, of the stepwise EM.
+         */
+        Matrix3D<double> _post_prob_sum_stat ;
+        /*!
+         * \brief the running motif base counts, per sequence, of
+         * the stepwise EM.
+         */
+        std::vector<Matrix2D<double>> _motif_counts_stat ;
+        /*!
+         * \brief the largest absolute change of a posterior
+         * probability during the last E-step.
+         */
+        double _post_prob_delta ;
+        /*!
+         * \brief the log likelihood of each sequence (that is the
+         * log of the normalizing constant of its posterior
+         * probabilities) computed during the last E-step.
+         */
+        std::vector<double> _log_likelihood_seq ;
+        /*!
+         * \brief the data log likelihood computed during the last
+         * E-step.
          */
-        Matrix4D<double> _post_prob_prev ;
+        double _log_likelihood ;
         /*!
-         * \brief the sequence likelihoods.
+         * \brief the data log likelihood computed during the
+         * E-step before the last one.
          */
-        Matrix4D<double> _likelihood ;
+        double _log_likelihood_prev ;
+        /*!
+         * \brief the sequence log likelihoods (empty in fused mode),
+         * over the shift band.
+         */
+        Matrix4D<T> _likelihood ;
+        /*!
+         * \brief the sequence log likelihoods given the background class
+         * (sequence, shift, flip), computed once since the background
+         * motif is never updated (empty without background class).
+         */
+        Matrix3D<T> _bg_likelihood ;
+        /*!
+         * \brief the prefix sums of the log background probabilities of
+         * the bases of each sequence, possibly shared with other instances,
+         * null if they are computed when needed.
+         */
+        std::shared_ptr<const Matrix3D<double>> _bg_log_prefix ;
         /*!
          * \brief the current number of iterations.
          */
         size_t _n_iter ;
+        /*!
+         * \brief the number of iterations run before the checkpoint
+         * this instance was restored from, 0 otherwise.
+         */
+        size_t _n_iter_start ;
         /*!
          * \brief the number of sequences.
          */
@@ -279,6 +1222,138 @@ class EMSequenceEngine : public ClusteringEngine
          * on the most central shift state.
          */
         bool _shift_center ;
+        /*!
+         * \brief the number of threads to use.
+         */
+        size_t _n_threads ;
+        /*!
+         * \brief whether the E-step and the M-step are run in a
+         * single pass, without storing the likelihoods.
+         */
+        bool _fused ;
+        /*!
+         * \brief whether the SQUAREM acceleration is used.
+         */
+        bool _squarem ;
+        /*!
+         * \brief the maximal SQUAREM step length, in absolute value.
+         * It starts at 1 (no extrapolation) and is multiplied by 4
+         * each time a step capped to it is accepted, and divided by 4
+         * each time a step is rejected.
+         */
+        double _squarem_step_max ;
+        /*!
+         * \brief the rule used to decide whether convergence is
+         * reached.
+         */
+        Constants::stopping_rules _stopping_rule ;
+        /*!
+         * \brief the relative log likelihood tolerance used by
+         * the log likelihood stopping rule.
+         */
+        double _tolerance ;
+        /*!
+         * \brief whether the sparse mode is used.
+         */
+        bool _sparse ;
+        /*!
+         * \brief the posterior probability under which a state
+         * is pruned in sparse mode.
+         */
+        double _sparse_threshold ;
+        /*!
+         * \brief the number of E-steps run in sparse mode.
+         */
+        size_t _sparse_n_step ;
+        /*!
+         * \brief whether the last E-step scored all the states in
+         * sparse mode.
+         */
+        bool _sparse_full ;
+        /*!
+         * \brief in sparse mode, for each sequence, the log of the
+         * posterior probability mass of the states kept at the last
+         * full rescoring.
+         */
+        std::vector<double> _sparse_log_mass ;
+        /*!
+         * \brief in sparse mode, the states kept for each sequence, as
+         * (state index, posterior probability) pairs sorted by state
+         * index (see decode_state()). _post_prob is then empty.
+         */
+        std::vector<std::vector<std::pair<uint32_t,T>>> _post_prob_sparse ;
+        /*!
+         * \brief the number of shifts on each side of the central
+         * shift which can be part of the shift band.
+         */
+        size_t _shift_window ;
+        /*!
+         * \brief the minimal prior probability of the shifts at the
+         * edges of the shift band, 0 if not used.
+         */
+        double _shift_threshold ;
+        /*!
+         * \brief the first shift of the shift band, the shift s of
+         * _likelihood and _post_prob is the shift _shift_from+s.
+         */
+        size_t _shift_from ;
+        /*!
+         * \brief the number of shifts in the shift band.
+         */
+        size_t _n_shift_band ;
+        /*!
+         * \brief whether the incremental mode is used.
+         */
+        bool _incremental ;
+        /*!
+         * \brief the largest posterior probability change under which
+         * a sequence is frozen in incremental mode.
+         */
+        double _incremental_threshold ;
+        /*!
+         * \brief the number of E-steps since the last full sweep in
+         * incremental mode.
+         */
+        size_t _incremental_n_step ;
+        /*!
+         * \brief whether the last E-step was a full sweep in
+         * incremental mode.
+         */
+        bool _incremental_full ;
+        /*!
+         * \brief the indices of the active sequences in incremental
+         * mode, in increasing order.
+         */
+        std::vector<size_t> _active_seq ;
+        /*!
+         * \brief the largest absolute change of a posterior probability
+         * of each sequence, the last time it was scored.
+         */
+        std::vector<double> _post_prob_delta_seq ;
+        /*!
+         * \brief the cached posterior probability sums in incremental
+         * mode.
+         */
+        Matrix3D<double> _post_prob_sum_cache ;
+        /*!
+         * \brief the cached motif base counts in incremental mode.
+         */
+        std::vector<Matrix2D<double>> _motif_counts_cache ;
+        /*!
+         * \brief whether the hard assignment mode is used.
+         */
+        bool _hard ;
+        /*!
+         * \brief in hard mode, the index of the state of each sequence
+         * (see decode_state()). _post_prob is then empty.
+         */
+        std::vector<uint32_t> _assignment ;
+        /*!
+         * \brief the random number generator of this instance, such
+         * that several instances can run concurrently and remain
+         * reproducible.
+         */
+        std::mt19937 _random_generator ;
 
 } ;
 
@@ -94,6 +94,13 @@ class Matrix
          */
         Matrix (const Matrix& other) ;
 
+        /*!
+         * \brief Move constructor.
+         * \param other the matrix to move the content from, which is
+         * left empty.
+         */
+        Matrix (Matrix&& other) ;
+
         /*!
          * \brief Destructor.
          */
@@ -188,6 +195,16 @@ class Matrix
          */
         Matrix& operator = (const Matrix<T>& other) ;
 
+        /*!
+         * \brief Move assignment operator. The memory of the current
+         * instance is released, unlike with the assignment operator
+         * which keeps it when the other matrix is not larger.
+         * \param other an other matrix to move the values from, which
+         * is left empty.
+         * \return a reference to the current instance.
+         */
+        Matrix& operator = (Matrix<T>&& other) ;
+
         /*!
          * \brief Adds value to each element.
          * \param value the value to add.
@@ -330,11 +347,11 @@ class Matrix
         /*!
          * \brief The number of dimensions.
          */
-        size_t _dim_size ;
+        size_t _dim_size = 0 ;
         /*!
          * \brief The number of data elements stored.
          */
-        size_t _data_size ;
+        size_t _data_size = 0 ;
 
         /*!
          * \brief Contains the partial product of the dimensions. That is,
@@ -440,6 +457,10 @@ template<class T>
 Matrix<T>::Matrix(const Matrix &other)
 {   *this = other ; }
 
+template<class T>
+Matrix<T>::Matrix(Matrix &&other)
+{   *this = std::move(other) ; }
+
 
 template<class T>
 T Matrix<T>::get(size_t offset) const throw(std::out_of_range)
@@ -512,6 +533,24 @@ Matrix<T>& Matrix<T>::operator = (const Matrix<T>& other)
     return *this ;
 }
 
+template<class T>
+Matrix<T>& Matrix<T>::operator = (Matrix<T>&& other)
+{   if(&other == this)
+    {   return *this ; }
+    this->_dim       = std::move(other._dim) ;
+    this->_dim_size  = other._dim_size ;
+    this->_data      = std::move(other._data) ;
+    this->_data_size = other._data_size ;
+    this->_dim_prod  = std::move(other._dim_prod) ;
+    // the other matrix is left empty
+    other._dim.clear() ;
+    other._data.clear() ;
+    other._dim_prod.clear() ;
+    other._dim_size  = 0 ;
+    other._data_size = 0 ;
+    return *this ;
+}
+
 template<class T>
 Matrix<T>& Matrix<T>::operator += (T value)
 {   for(auto& i : this->_data)
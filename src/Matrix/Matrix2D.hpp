@@ -2,6 +2,7 @@
 #define MATRIX2D_HPP
 
 #include "Matrix.hpp"
+#include "MatrixND.hpp"
 
 #include <vector>
 #include <string>
@@ -34,7 +35,7 @@
  *
  */
 template<class T>
-class Matrix2D : public Matrix<T>
+class Matrix2D : public MatrixND<T,2>
 {
     public:
         // constructors
@@ -60,6 +61,12 @@ class Matrix2D : public Matrix<T>
          * \param other the matrix to copy the content from.
          */
         Matrix2D(const Matrix2D& other) ;
+        /*!
+         * \brief Move constructor.
+         * \param other the matrix to move the content from, which is
+         * left empty.
+         */
+        Matrix2D(Matrix2D&& other) = default ;
         /*!
          * \brief Constructs a matrix from a text file. A matrix contructed
          * from an empty file (or a file containing only one EOL char) returns
@@ -75,6 +82,22 @@ class Matrix2D : public Matrix<T>
          */
         virtual ~Matrix2D() = default ;
 
+        // operators
+        /*!
+         * \brief Assignment operator.
+         * \param other an other matrix to copy the values from.
+         * \return a reference to the current instance.
+         */
+        Matrix2D& operator = (const Matrix2D& other) = default ;
+        /*!
+         * \brief Move assignment operator, the memory of the current
+         * instance is released.
+         * \param other an other matrix to move the values from, which
+         * is left empty.
+         * \return a reference to the current instance.
+         */
+        Matrix2D& operator = (Matrix2D&& other) = default ;
+
         // methods overloaded in Matrix
         using Matrix<T>::get ;
         using Matrix<T>::set ;        
@@ -279,12 +302,12 @@ Matrix2D<T>::Matrix2D(size_t nrow, size_t ncol)
 
 template<class T>
 Matrix2D<T>::Matrix2D(size_t nrow, size_t ncol, T value)
-     : Matrix<T>({nrow, ncol}, value)
+     : MatrixND<T,2>({nrow, ncol}, value)
 {}
 
 template<class T>
 Matrix2D<T>::Matrix2D(const Matrix2D<T>& other)
-    : Matrix<T>(other)
+    : MatrixND<T,2>(other)
 {}
 
 template<class T>
@@ -464,16 +487,12 @@ void Matrix2D<T>::print(std::ostream& stream, size_t precision, size_t width, ch
 
 template<class T>
 T& Matrix2D<T>::operator () (size_t row, size_t col)
-{   std::vector<size_t> coord = {col, row} ;
-    return this->_data[this->convert_to_offset(coord)] ;
-}
+{   return this->_data[this->convert_to_offset({{row, col}})] ; }
 
 
 template<class T>
 const T& Matrix2D<T>::operator () (size_t row, size_t col) const
-{   std::vector<size_t> coord = {col, row} ;
-    return this->_data[this->convert_to_offset(coord)] ;
-}
+{   return this->_data[this->convert_to_offset({{row, col}})] ; }
 
 
 #endif // MATRIX2D_HPP
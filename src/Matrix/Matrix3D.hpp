@@ -2,6 +2,7 @@
 #define MATRIX3D_HPP
 
 #include "Matrix.hpp"
+#include "MatrixND.hpp"
 
 #include <string>
 #include <vector>
@@ -48,7 +49,7 @@
  *
  */
 template<class T>
-class Matrix3D : public Matrix<T>
+class Matrix3D : public MatrixND<T,3>
 {
     public:
         // constructors
@@ -76,6 +77,12 @@ class Matrix3D : public Matrix<T>
          * \param other the matrix to copy the content from.
          */
         Matrix3D(const Matrix3D& other) ;
+        /*!
+         * \brief Move constructor.
+         * \param other the matrix to move the content from, which is
+         * left empty.
+         */
+        Matrix3D(Matrix3D&& other) = default ;
         /*!
          * \brief Constructs a matrix from a text file. A matrix contructed
          * from an empty file (or a file containing only one EOL char) returns
@@ -91,6 +98,22 @@ class Matrix3D : public Matrix<T>
          */
         virtual ~Matrix3D() = default ;
 
+        // operators
+        /*!
+         * \brief Assignment operator.
+         * \param other an other matrix to copy the values from.
+         * \return a reference to the current instance.
+         */
+        Matrix3D& operator = (const Matrix3D& other) = default ;
+        /*!
+         * \brief Move assignment operator, the memory of the current
+         * instance is released.
+         * \param other an other matrix to move the values from, which
+         * is left empty.
+         * \return a reference to the current instance.
+         */
+        Matrix3D& operator = (Matrix3D&& other) = default ;
+
         // methods overloaded from Matrix
         using Matrix<T>::get ;
         using Matrix<T>::set ;
@@ -240,12 +263,12 @@ Matrix3D<T>::Matrix3D(size_t dim1, size_t dim2, size_t dim3)
 
 template<class T>
 Matrix3D<T>::Matrix3D(size_t dim1, size_t dim2, size_t dim3, T value)
-    : Matrix<T>({dim1, dim2, dim3}, value)
+    : MatrixND<T,3>({dim1, dim2, dim3}, value)
 {}
 
 template<class T>
 Matrix3D<T>::Matrix3D(const Matrix3D &other)
-    : Matrix<T>(other)
+    : MatrixND<T,3>(other)
 {}
 
 
@@ -395,8 +418,7 @@ void Matrix3D<T>::set(size_t dim1, size_t dim2, size_t dim3, T value) throw(std:
 
 template<class T>
 T& Matrix3D<T>::operator () (size_t dim1, size_t dim2, size_t dim3)
-{   std::vector<size_t> coord = {dim2, dim1, dim3} ;
-    return this->_data[this->convert_to_offset(coord)] ;
+{   return this->_data[this->convert_to_offset({{dim1, dim2, dim3}})] ;
 }
 
 
@@ -427,8 +449,7 @@ void Matrix3D<T>::print(std::ostream& stream, size_t precision, size_t width, ch
 
 template<class T>
 const T& Matrix3D<T>::operator () (size_t dim1, size_t dim2, size_t dim3) const
-{   std::vector<size_t> coord = {dim2, dim1, dim3} ;
-    return this->_data[this->convert_to_offset(coord)] ;
+{   return this->_data[this->convert_to_offset({{dim1, dim2, dim3}})] ;
 }
 
 
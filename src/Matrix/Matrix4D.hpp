@@ -2,6 +2,7 @@
 #define MATRIX4D_HPP
 
 #include "Matrix.hpp"
+#include "MatrixND.hpp"
 
 #include <string>
 #include <vector>
@@ -55,7 +56,7 @@
  *
  */
 template<class T>
-class Matrix4D : public Matrix<T>
+class Matrix4D : public MatrixND<T,4>
 {
     public:
         // constructors
@@ -85,6 +86,12 @@ class Matrix4D : public Matrix<T>
          * \param other the matrix to copy the content from.
          */
         Matrix4D(const Matrix4D& other) ;
+        /*!
+         * \brief Move constructor.
+         * \param other the matrix to move the content from, which is
+         * left empty.
+         */
+        Matrix4D(Matrix4D&& other) = default ;
         /*!
          * \brief Constructs a matrix from a text file. A matrix contructed
          * from an empty file (or a file containing only one EOL char) returns
@@ -100,6 +107,22 @@ class Matrix4D : public Matrix<T>
          */
         virtual ~Matrix4D() = default ;
 
+        // operators
+        /*!
+         * \brief Assignment operator.
+         * \param other an other matrix to copy the values from.
+         * \return a reference to the current instance.
+         */
+        Matrix4D& operator = (const Matrix4D& other) = default ;
+        /*!
+         * \brief Move assignment operator, the memory of the current
+         * instance is released.
+         * \param other an other matrix to move the values from, which
+         * is left empty.
+         * \return a reference to the current instance.
+         */
+        Matrix4D& operator = (Matrix4D&& other) = default ;
+
         // methods overloaded from Matrix
         using Matrix<T>::get ;
         using Matrix<T>::set ;
@@ -286,17 +309,17 @@ std::ostream& operator << (std::ostream& stream, const Matrix4D<T>& m)
 // method implementation
 template<class T>
 Matrix4D<T>::Matrix4D(size_t dim1, size_t dim2, size_t dim3, size_t dim4)
-    : Matrix<T>({dim1, dim2, dim3, dim4}, 0)
+    : MatrixND<T,4>({dim1, dim2, dim3, dim4}, 0)
 {}
 
 template<class T>
 Matrix4D<T>::Matrix4D(size_t dim1, size_t dim2, size_t dim3, size_t dim4, T value)
-    : Matrix<T>({dim1, dim2, dim3, dim4}, value)
+    : MatrixND<T,4>({dim1, dim2, dim3, dim4}, value)
 {}
 
 template<class T>
 Matrix4D<T>::Matrix4D(const Matrix4D &other)
-    : Matrix<T>(other)
+    : MatrixND<T,4>(other)
 {}
 
 template<class T>
@@ -453,14 +476,12 @@ void Matrix4D<T>::print(std::ostream &stream, size_t precision, size_t width, ch
 
 template<class T>
 T& Matrix4D<T>::operator () (size_t dim1, size_t dim2, size_t dim3, size_t dim4)
-{   std::vector<size_t> coord = {dim2, dim1, dim3, dim4} ;
-    return this->_data[this->convert_to_offset(coord)] ;
+{   return this->_data[this->convert_to_offset({{dim1, dim2, dim3, dim4}})] ;
 }
 
 template<class T>
 const T& Matrix4D<T>::operator () (size_t dim1, size_t dim2, size_t dim3, size_t dim4) const
-{   std::vector<size_t> coord = {dim2, dim1, dim3, dim4} ;
-    return this->_data[this->convert_to_offset(coord)] ;
+{   return this->_data[this->convert_to_offset({{dim1, dim2, dim3, dim4}})] ;
 }
 
 template<class T>
@@ -0,0 +1,156 @@
+#ifndef MATRIXND_HPP
+#define MATRIXND_HPP
+
+#include "Matrix.hpp"
+
+#include <array>
+#include <vector>
+
+
+/*!
+ * \brief The MatrixND class is an intermediate layer between the
+ * generic Matrix class and the Matrix2D, Matrix3D and Matrix4D
+ * classes. It fixes the number of dimensions at compile time
+ * (the N template parameter) which allows to store the partial
+ * dimension products in a std::array and to convert coordinates
+ * to offsets without building any temporary vector.
+ *
+ * The partial products are stored in the (row, col, ...) order
+ * used by the user given coordinates such that no swap is needed :
+ * for a 2D matrix, the row stride is the number of columns and the
+ * column stride is 1. The other dimensions are left unchanged.
+ *
+ * Any class deriving from MatrixND and modifying this->_dim outside
+ * of a constructor should call compute_dim_product() afterwards to
+ * keep the strides up to date.
+ */
+template<class T, size_t N>
+class MatrixND : public Matrix<T>
+{
+    public:
+        // constructors
+        MatrixND() = default ;
+        /*!
+         * \brief Constructs a matrix with the given dimensions and
+         * initialize the values to the given value.
+         * \param dim the dimensions, in (row, col, ...) format. Its
+         * length should be N.
+         * \param value the value to initialize the matrix content
+         * with.
+         */
+        MatrixND(const std::vector<size_t>& dim, T value) ;
+        /*!
+         * \brief Copy constructor.
+         * \param other the matrix to copy.
+         */
+        MatrixND(const MatrixND& other) ;
+        /*!
+         * \brief Move constructor.
+         * \param other the matrix to move the content from, which is
+         * left empty.
+         */
+        MatrixND(MatrixND&& other) ;
+
+        /*!
+         * \brief Destructor.
+         */
+        virtual ~MatrixND() = default ;
+
+        // operator
+        /*!
+         * \brief Assignment operator.
+         * \param other an other matrix to copy the values from.
+         * \return a reference to the current instance.
+         */
+        MatrixND& operator = (const MatrixND& other) ;
+        /*!
+         * \brief Move assignment operator, the memory of the current
+         * instance is released.
+         * \param other an other matrix to move the values from, which
+         * is left empty.
+         * \return a reference to the current instance.
+         */
+        MatrixND& operator = (MatrixND&& other) ;
+
+    protected:
+        // methods
+        /*!
+         * \brief Computes the partial dimension products and fills
+         * this->_dim_prod and this->_strides according to the current
+         * values of this->_dim and this->_dim_size.
+         */
+        void compute_dim_product() ;
+
+        /*!
+         * \brief Converts a set of (row, col, ...) coordinates into
+         * the corresponding offset in the data vector. This method
+         * does not perform any check on the coordinates.
+         * \param coord the coordinates in (row, col, ...) format.
+         * \return the corresponding offset.
+         */
+        inline size_t convert_to_offset(const std::array<size_t,N>& coord) const ;
+
+        // fields
+        /*!
+         * \brief Contains the partial product of the dimensions, in
+         * (row, col, ...) order. That is, the ith element contains the
+         * offset distance between two elements differing by 1 in the
+         * ith coordinate.
+         */
+        std::array<size_t,N> _strides {} ;
+} ;
+
+
+// method implementation
+template<class T, size_t N>
+MatrixND<T,N>::MatrixND(const std::vector<size_t>& dim, T value)
+    : Matrix<T>(dim, value)
+{   this->compute_dim_product() ; }
+
+template<class T, size_t N>
+MatrixND<T,N>::MatrixND(const MatrixND<T,N>& other)
+    : Matrix<T>(other), _strides(other._strides)
+{}
+
+template<class T, size_t N>
+MatrixND<T,N>::MatrixND(MatrixND<T,N>&& other)
+    : Matrix<T>(std::move(other)), _strides(other._strides)
+{   other._strides.fill(0) ; }
+
+template<class T, size_t N>
+MatrixND<T,N>& MatrixND<T,N>::operator = (const MatrixND<T,N>& other)
+{   Matrix<T>::operator = (other) ;
+    this->_strides = other._strides ;
+    return *this ;
+}
+
+template<class T, size_t N>
+MatrixND<T,N>& MatrixND<T,N>::operator = (MatrixND<T,N>&& other)
+{   if(&other == this)
+    {   return *this ; }
+    Matrix<T>::operator = (std::move(other)) ;
+    this->_strides = other._strides ;
+    other._strides.fill(0) ;
+    return *this ;
+}
+
+template<class T, size_t N>
+void MatrixND<T,N>::compute_dim_product()
+{   Matrix<T>::compute_dim_product() ;
+    for(size_t i=0; i<N; i++)
+    {   this->_strides[i] = this->_dim_prod[i] ; }
+    // (x,y,...) -> (row,col,...)
+    if(N > 1)
+    {   std::swap(this->_strides[0], this->_strides[1]) ; }
+}
+
+template<class T, size_t N>
+inline size_t MatrixND<T,N>::convert_to_offset(const std::array<size_t,N>& coord) const
+{   size_t offset = 0 ;
+    // N is known at compile time, this loop is unrolled
+    for(size_t i=0; i<N; i++)
+    {   offset += coord[i] * this->_strides[i] ; }
+    return offset ;
+}
+
+#endif // MATRIXND_HPP
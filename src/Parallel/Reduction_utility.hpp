@@ -0,0 +1,25 @@
+#ifndef REDUCTION_UTILITY_HPP
+#define REDUCTION_UTILITY_HPP
+
+#include <vector>
+
+/*! \brief Merges a vector of partial results, for instance computed
+ * by different threads, into its first element using a pairwise tree
+ * reduction : at each level, the partial at index i+step is merged into
+ * the partial at index i, for i multiple of 2*step. The order in which
+ * the partials are merged only depends on their number, such that the
+ * result is deterministic.
+ * \param partials the partial results, the final result is stored in
+ * partials[0]. The other elements are left in an unspecified state.
+ * \param merge a callable with signature void(T& lhs, const T& rhs)
+ * merging rhs into lhs.
+ */
+template<class T, class Merge>
+void tree_reduce(std::vector<T>& partials, Merge merge)
+{   for(size_t step=1; step<partials.size(); step*=2)
+    {   for(size_t i=0; i+step<partials.size(); i+=2*step)
+        {   merge(partials[i], partials[i+step]) ; }
+    }
+}
+
+#endif // REDUCTION_UTILITY_HPP
@@ -1,9 +1,10 @@
 #include "ThreadPool.hpp"
-#include <chrono>
+
 
 ThreadPool::ThreadPool(size_t n_threads, bool debug)
     : queue_task(),
       queue_mutex(),
+      queue_cv(),
       queue_open(true),
       debug(debug)
 {   assert(n_threads > 0) ;
@@ -14,7 +15,9 @@ ThreadPool::ThreadPool(size_t n_threads, bool debug)
 
 
 ThreadPool::~ThreadPool()
-{}
+{   // never leave joinable threads behind
+    this->join() ;
+}
 
 
 size_t ThreadPool::getNThread() const
@@ -23,14 +26,12 @@ size_t ThreadPool::getNThread() const
 
 void ThreadPool::addJob(std::function<void()>&& task)
 {   // only add a job in the queues if they are open
-    if(this->isQueueOpen())
-    {   this->lock_mutex_queue() ;
-        // this->debug_print(std::string("started adding job")) ;
-        this->queue_task.push(task) ;
-        // this->debug_print(std::string("ended adding job")) ;
-        this->unlock_mutex_queue() ;
+    {   std::lock_guard<std::mutex> lock(this->queue_mutex) ;
+        if(not this->queue_open)
+        {   return ; }
+        this->queue_task.push(std::move(task)) ;
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(5)) ;
+    this->queue_cv.notify_one() ;
 }
 
 
@@ -56,55 +57,42 @@ void ThreadPool::thread_routine()
     {
         // get a function and the arguments value from the queue
         std::function<void()> task ;
-        bool has_task      = false ;
-        bool is_queue_open = this->isQueueOpen() ;
-        std::pair<size_t,size_t> args ;
-        this->lock_mutex_queue() ;
-        bool is_queue_empty   = this->queue_task.empty() ;
-        if(not is_queue_empty)
-        {   // this->debug_print(std::string("fetching from queue")) ;
-            task = this->queue_task.front() ;
+        {   std::unique_lock<std::mutex> lock(this->queue_mutex) ;
+            this->queue_cv.wait(lock, [this] { return (not this->queue_open) or
+                                                      (not this->queue_task.empty()) ; }) ;
+            // exit, the queue is closed and empty
+            if(this->queue_task.empty())
+            {   break ; }
+            task = std::move(this->queue_task.front()) ;
             this->queue_task.pop() ;
-            has_task = true ;
         }
-        this->unlock_mutex_queue() ;
 
         // runs the task
-        if(has_task)
-        {   this->debug_print(std::string("working")) ;
-            task() ;
-        }
-        // exit
-        else if(is_queue_empty and not is_queue_open)
-        {   break ; }
-        std::this_thread::sleep_for(std::chrono::milliseconds(10)) ;
+        this->debug_print(std::string("working")) ;
+        task() ;
     }
     this->debug_print(std::string("ended")) ;
 }
 
 
-void ThreadPool::lock_mutex_queue()
-{   this->queue_mutex.lock() ;
-    // this->debug_print(std::string("locked mutex")) ;
-}
-
-
-void ThreadPool::unlock_mutex_queue()
-{   this->queue_mutex.unlock() ;
-    // this->debug_print(std::string("unlocked mutex")) ;
-}
-
-
 void ThreadPool::open_queue()
-{   this->queue_open = true ; }
+{   std::lock_guard<std::mutex> lock(this->queue_mutex) ;
+    this->queue_open = true ;
+}
 
 
 void ThreadPool::close_queue()
-{   this->queue_open = false ; }
+{   {   std::lock_guard<std::mutex> lock(this->queue_mutex) ;
+        this->queue_open = false ;
+    }
+    this->queue_cv.notify_all() ;
+}
 
 
 bool ThreadPool::isQueueOpen()
-{   return this->queue_open ; }
+{   std::lock_guard<std::mutex> lock(this->queue_mutex) ;
+    return this->queue_open ;
+}
 
 
 bool ThreadPool::isDebugOn() const
@@ -119,4 +107,3 @@ void ThreadPool::debug_print(const std::string& msg, std::ostream& out) const
         out << message ;
     }
 }
-
@@ -7,6 +7,8 @@
 #include <thread>
 #include <queue>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <string>
 
 
@@ -24,7 +26,9 @@ typedef void (*function_ptr)(size_t, size_t) ;
  * be push into the queue anymore.
  * Stopping the pool is done through calling join() which will close the queue
  * - and eventually let the threads empty it - and join all the threads.
- * Any access to the queue is synchonized through the use of a mutex.
+ * Any access to the queue is synchonized through the use of a mutex. Idle
+ * threads wait on a condition variable until a job is added or the queue is
+ * closed.
  */
 class ThreadPool
 {
@@ -77,16 +81,6 @@ class ThreadPool
          */
         void thread_routine() ;
 
-        /*!
-         * \brief locks the queue accession mutex.
-         */
-        void lock_mutex_queue() ;
-
-        /*!
-         * \brief unlocks the queue accession mutex.
-         */
-        void unlock_mutex_queue() ;
-
         /*!
          * \brief opens the jobs queue. Later calls to
          * addJob() have an effect.
@@ -94,8 +88,9 @@ class ThreadPool
         void open_queue() ;
 
         /*!
-         * \brief closes the jobs queue. Later calls to
-         * addJob() remains effectless.
+         * \brief closes the jobs queue and wakes up all
+         * the idle threads. Later calls to addJob() remains
+         * effectless.
          */
         void close_queue() ;
 
@@ -134,6 +129,12 @@ class ThreadPool
          * the queues.
          */
         std::mutex queue_mutex ;
+        /*!
+         * \brief signals the idle threads that a job
+         * has been added or that the queue has been
+         * closed.
+         */
+        std::condition_variable queue_cv ;
         /*!
          * \brief whether the queues are open for pushing
          * or not.
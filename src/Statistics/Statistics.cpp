@@ -1,8 +1,22 @@
 #include "Statistics.hpp"
 
 #include <cmath>
+#include <vector>
+#include <algorithm>  // max_element()
 
 double dnorm(double x, double mean, double sd)
 {   static double pi_2 = 2.*M_PI ;
     return ( 1. / ( sd * sqrt(pi_2) )) * exp(-0.5 * pow((x-mean)/sd, 2.0 ) );
 }
+
+double log_normalize(std::vector<double>& x)
+{   double max = *std::max_element(x.begin(), x.end()) ;
+    double sum = 0. ;
+    for(auto& value : x)
+    {   value = exp(value - max) ;
+        sum  += value ;
+    }
+    for(auto& value : x)
+    {   value /= sum ; }
+    return max + log(sum) ;
+}
@@ -18,6 +18,18 @@
  */
 double dnorm(double x, double mean, double sd) ;
 
+/*!
+ * \brief Turns, in place, a vector of log weights into probabilities.
+ * The normalization is done in log space, using a max-subtracted
+ * log-sum-exp, such that the weights can be arbitrarily small without
+ * underflowing all to 0 : exp(x[i] - lse) with
+ * lse = max(x) + log(sum(exp(x - max(x)))).
+ * \param x a vector of log weights, on return contains the
+ * corresponding probabilities. Should not be empty.
+ * \return the log of the sum of the weights (the log-sum-exp).
+ */
+double log_normalize(std::vector<double>& x) ;
+
 /*!
  * \brief Computes the weighted mean of a vector of measures <x> given their
  * probability <p>. The sum of <p> is expected to be 1, if not it will
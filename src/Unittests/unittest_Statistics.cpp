@@ -131,37 +131,23 @@ SUITE(Statistics_testsuit)
         double results7  = cor_pearson(v1, v2, 0, 1, 3, 4) ;
         CHECK_EQUAL(expected7, isNaN(results7)) ;
     }
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
 
+    TEST(log_normalize_test)
+    {   // tolerated error for equality testing
+        double error = 0.000001 ;
 
+        // regular values
+        vector<double> x1 = {log(1.), log(2.), log(3.), log(4.)} ;
+        vector<double> expected1 = {0.1, 0.2, 0.3, 0.4} ;
+        double lse1 = log_normalize(x1) ;
+        CHECK_CLOSE(log(10.), lse1, error) ;
+        CHECK_ARRAY_CLOSE(expected1, x1, 4, error) ;
+
+        // values which would underflow to 0 if exponentiated directly
+        vector<double> x2 = {-2000., -2000. + log(3.)} ;
+        vector<double> expected2 = {0.25, 0.75} ;
+        double lse2 = log_normalize(x2) ;
+        CHECK_CLOSE(-2000. + log(4.), lse2, error) ;
+        CHECK_ARRAY_CLOSE(expected2, x2, 2, error) ;
+    }
+}
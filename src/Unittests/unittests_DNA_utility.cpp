@@ -5,6 +5,8 @@
 
 #include "Utility/DNA_utility.hpp"
 #include "Matrix/Matrix2D.hpp"
+#include "Matrix/Matrix3D.hpp"
+#include "Utility/PackedSequenceSet.hpp"
 
 #include "Utility/Vector_utility.hpp"
 
@@ -106,6 +108,82 @@ SUITE(DNA_utility)
         CHECK_CLOSE(.5, exp(dna::score_sequence(sequences, 1, 1, motif2)), error) ;
     }
 
+    // tests dna::set_score_all_shifts_kernel()
+    TEST(set_score_all_shifts_kernel)
+    {   std::string kernel = dna::score_all_shifts_kernel() ;
+        std::vector<std::string> kernels = dna::score_all_shifts_kernels() ;
+        CHECK_EQUAL("generic", kernels.front()) ;
+        // the widest implementation is used by default
+        CHECK_EQUAL(kernels.back(), kernel) ;
+
+        for(const auto& k : kernels)
+        {   dna::set_score_all_shifts_kernel(k) ;
+            CHECK_EQUAL(k, dna::score_all_shifts_kernel()) ;
+        }
+        CHECK_THROW(dna::set_score_all_shifts_kernel("sse"), std::invalid_argument) ;
+        dna::set_score_all_shifts_kernel(kernel) ;
+    }
+
+    // tests dna::score_all_shifts_all_motifs(), with each implementation
+    // supported
+    TEST(score_all_shifts_all_motifs)
+    {   std::string kernel = dna::score_all_shifts_kernel() ;
+
+        // long enough to use full SIMD blocks and a remainder
+        Matrix2D<char> sequences(1,70) ;
+        for(size_t j=0; j<70; j++)
+        {   sequences(0,j) = "ACGT"[(j*j + j/3) % 4] ; }
+        PackedSequenceSet set(sequences) ;
+        std::vector<int32_t> sequence ;
+        set.decode(0, sequence) ;
+
+        for(const auto& name : dna::score_all_shifts_kernels())
+        {   dna::set_score_all_shifts_kernel(name) ;
+
+            // number of motifs such that the shifts or the motifs are
+            // vectorized and such that the SIMD blocks are full or not
+            for(size_t n_class : {1, 2, 3, 5})
+            {   for(size_t l_motif : {1, 13, 70})
+                {   std::vector<Matrix2D<double>> motifs ;
+                    std::vector<Matrix2D<double>> motifs_rev ;
+                    for(size_t k=0; k<n_class; k++)
+                    {   Matrix2D<double> motif(4,l_motif) ;
+                        Matrix2D<double> motif_rev(4,l_motif) ;
+                        for(size_t i=0; i<4; i++)
+                        {   for(size_t j=0; j<l_motif; j++)
+                            {   motif(i,j) = log(0.1 + 0.2*i) - 0.01*j - 0.1*k ;
+                                motif_rev(3-i,l_motif-j-1) = motif(i,j) ;
+                            }
+                        }
+                        motifs.push_back(motif) ;
+                        motifs_rev.push_back(motif_rev) ;
+                    }
+                    size_t n_shift = 70-l_motif+1 ;
+                    std::vector<double> scores ;
+
+                    // forward strand only
+                    dna::score_all_shifts_all_motifs(sequence, dna::interleave_motifs(motifs, false), n_class, scores) ;
+                    CHECK_EQUAL(n_shift*n_class, scores.size()) ;
+                    for(size_t s=0; s<n_shift; s++)
+                    {   for(size_t k=0; k<n_class; k++)
+                        {   CHECK_EQUAL(dna::score_sequence(set, 0, s, motifs[k]), scores[s*n_class + k]) ; }
+                    }
+
+                    // both strands
+                    dna::score_all_shifts_all_motifs(sequence, dna::interleave_motifs(motifs, true), 2*n_class, scores) ;
+                    CHECK_EQUAL(n_shift*2*n_class, scores.size()) ;
+                    for(size_t s=0; s<n_shift; s++)
+                    {   for(size_t k=0; k<n_class; k++)
+                        {   CHECK_EQUAL(dna::score_sequence(set, 0, s, motifs[k]),     scores[(s*n_class + k)*2]) ;
+                            CHECK_EQUAL(dna::score_sequence(set, 0, s, motifs_rev[k]), scores[(s*n_class + k)*2 + 1]) ;
+                        }
+                    }
+                }
+            }
+        }
+        dna::set_score_all_shifts_kernel(kernel) ;
+    }
+
     // tests dna::base_composition()
     TEST(base_composition)
     {
@@ -131,4 +209,112 @@ SUITE(DNA_utility)
             CHECK_THROW(dna::base_composition(sequences_2, true),  std::invalid_argument) ;
        }
     }
+
+    // tests dna::background_log_prefix()
+    TEST(background_log_prefix)
+    {   Matrix2D<char> sequences(2,4) ;
+        sequences(0,0) = 'A' ; sequences(0,1) = 'C' ; sequences(0,2) = 'G' ; sequences(0,3) = 'T' ;
+        sequences(1,0) = 'A' ; sequences(1,1) = 'A' ; sequences(1,2) = 'T' ; sequences(1,3) = 'G' ;
+        PackedSequenceSet set(sequences) ;
+        std::vector<double> bg_prob = {0.1, 0.2, 0.3, 0.4} ;
+
+        Matrix3D<double> prefix     = dna::background_log_prefix(set, bg_prob, false) ;
+        Matrix3D<double> prefix_rev = dna::background_log_prefix(set, bg_prob, true) ;
+        CHECK_EQUAL(2, prefix.get_dim()[0]) ;
+        CHECK_EQUAL(5, prefix.get_dim()[1]) ;
+        CHECK_EQUAL(1, prefix.get_dim()[2]) ;
+        CHECK_EQUAL(2, prefix_rev.get_dim()[2]) ;
+
+        // the difference of two values is the log likelihood of the bases in between
+        for(size_t i=0; i<2; i++)
+        {   CHECK_EQUAL(0., prefix(i,0,0)) ;
+            for(size_t from=0; from<4; from++)
+            {   for(size_t to=from+1; to<=4; to++)
+                {   double ll = 0., ll_rev = 0. ;
+                    for(size_t j=from; j<to; j++)
+                    {   ll     += log(bg_prob[dna::hash(sequences(i,j))]) ;
+                        ll_rev += log(bg_prob[dna::hash(sequences(i,j), true)]) ;
+                    }
+                    CHECK_CLOSE(ll,     prefix(i,to,0)     - prefix(i,from,0),     1e-12) ;
+                    CHECK_CLOSE(ll,     prefix_rev(i,to,0) - prefix_rev(i,from,0), 1e-12) ;
+                    CHECK_CLOSE(ll_rev, prefix_rev(i,to,1) - prefix_rev(i,from,1), 1e-12) ;
+                }
+            }
+        }
+
+        // wrong number of probabilities
+        CHECK_THROW(dna::background_log_prefix(set, std::vector<double>(3, 1./3.)), std::invalid_argument) ;
+    }
+
+    // tests dna::count_kmers() and dna::kmer_reverse_complement()
+    TEST(count_kmers)
+    {   Matrix2D<char> sequences(2,5) ;
+        sequences(0,0) = 'A' ; sequences(0,1) = 'C' ; sequences(0,2) = 'G' ; sequences(0,3) = 'T' ; sequences(0,4) = 'A' ;
+        sequences(1,0) = 'A' ; sequences(1,1) = 'A' ; sequences(1,2) = 'A' ; sequences(1,3) = 'C' ; sequences(1,4) = 'G' ;
+        PackedSequenceSet set(sequences) ;
+
+        // the code of a k-mer, first base most significant
+        auto encode = [](const std::string& kmer)
+                      {   uint64_t code = 0 ;
+                          for(char base : kmer)
+                          {   code = (code << 2) | dna::hash(base) ; }
+                          return code ;
+                      } ;
+
+        // forward strand only, 3-mers : ACG CGT GTA AAA AAC ACG
+        std::vector<uint64_t> counts(64, 0) ;
+        dna::count_kmers(set, 3, false, 0, 2, counts) ;
+        std::vector<uint64_t> counts_exp(64, 0) ;
+        for(const auto& kmer : {"ACG", "CGT", "GTA", "AAA", "AAC", "ACG"})
+        {   counts_exp[encode(kmer)]++ ; }
+        CHECK_ARRAY_EQUAL(counts_exp, counts, counts_exp.size()) ;
+
+        // both strands, the counts are added
+        dna::count_kmers(set, 3, true, 0, 1, counts) ;
+        for(const auto& kmer : {"ACG", "CGT", "GTA", "CGT", "ACG", "TAC"})
+        {   counts_exp[encode(kmer)]++ ; }
+        CHECK_ARRAY_EQUAL(counts_exp, counts, counts_exp.size()) ;
+
+        // reverse complement codes
+        CHECK_EQUAL(encode("TAC"), dna::kmer_reverse_complement(encode("GTA"), 3)) ;
+        CHECK_EQUAL(encode("TTTG"), dna::kmer_reverse_complement(encode("CAAA"), 4)) ;
+
+        // wrong k-mer length or table size
+        CHECK_THROW(dna::count_kmers(set, 0, false, 0, 2, counts), std::invalid_argument) ;
+        CHECK_THROW(dna::count_kmers(set, 2, false, 0, 2, counts), std::invalid_argument) ;
+    }
+
+    // tests dna::best_site_log_odds()
+    TEST(best_site_log_odds)
+    {   Matrix2D<char> sequences(2,4) ;
+        sequences(0,0) = 'A' ; sequences(0,1) = 'C' ; sequences(0,2) = 'G' ; sequences(0,3) = 'T' ;
+        sequences(1,0) = 'A' ; sequences(1,1) = 'A' ; sequences(1,2) = 'A' ; sequences(1,3) = 'C' ;
+        PackedSequenceSet set(sequences) ;
+        std::vector<double> bg(4, 0.25) ;
+
+        // a motif favouring "AC" and one favouring "GT"
+        Matrix2D<double> motif_ac(4, 2, 0.1) ;
+        motif_ac(0,0) = 0.7 ; motif_ac(1,1) = 0.7 ;
+        Matrix2D<double> motif_gt(4, 2, 0.1) ;
+        motif_gt(2,0) = 0.7 ; motif_gt(3,1) = 0.7 ;
+        std::vector<Matrix2D<double>> motifs = {motif_ac, motif_gt} ;
+        double hit  = std::log(0.7/0.25) ;
+        double miss = std::log(0.1/0.25) ;
+
+        // forward strand, AC is found in both sequences, GT in the first only
+        std::vector<double> scores = dna::best_site_log_odds(set, motifs, bg) ;
+        std::vector<double> scores_exp = {2.*hit, (2.*hit + 2.*miss) / 2.} ;
+        CHECK_ARRAY_CLOSE(scores_exp, scores, scores_exp.size(), 1e-12) ;
+
+        // both strands, GT is the reverse complement of AC
+        scores     = dna::best_site_log_odds(set, motifs, bg, true) ;
+        scores_exp = {2.*hit, 2.*hit} ;
+        CHECK_ARRAY_CLOSE(scores_exp, scores, scores_exp.size(), 1e-12) ;
+
+        // motifs of different lengths, too long or wrong background
+        motifs.push_back(Matrix2D<double>(4, 3, 0.25)) ;
+        CHECK_THROW(dna::best_site_log_odds(set, motifs, bg), std::invalid_argument) ;
+        CHECK_THROW(dna::best_site_log_odds(set, {Matrix2D<double>(4, 5, 0.25)}, bg), std::invalid_argument) ;
+        CHECK_THROW(dna::best_site_log_odds(set, {motif_ac}, std::vector<double>(3, 1./3.)), std::invalid_argument) ;
+    }
 }
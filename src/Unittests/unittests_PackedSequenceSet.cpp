@@ -0,0 +1,125 @@
+#include <UnitTest++/UnitTest++.h>
+#include <stdexcept> // invalid_argument, out_of_range
+#include <string>
+#include <cctype>    // toupper()
+
+#include "Utility/PackedSequenceSet.hpp"
+#include "Utility/DNA_utility.hpp"
+#include "Matrix/Matrix2D.hpp"
+
+
+SUITE(PackedSequenceSet)
+{
+    // displays message
+    TEST(message)
+    {   std::cout << "Starting PackedSequenceSet tests..." << std::endl ; }
+
+    // tests the constructor and the base access, for sequences
+    // spanning several words
+    TEST(constructor)
+    {   std::string bases("ACGTacgt") ;
+        for(size_t l=0; l<100; l++)
+        {   Matrix2D<char> sequences(3, l) ;
+            for(size_t i=0; i<3; i++)
+            {   for(size_t j=0; j<l; j++)
+                {   sequences(i,j) = bases[(i*7 + j*3) % bases.size()] ; }
+            }
+            PackedSequenceSet set(sequences) ;
+            CHECK_EQUAL(3, set.get_nseq()) ;
+            CHECK_EQUAL(l, set.get_lseq()) ;
+            for(size_t i=0; i<3; i++)
+            {   for(size_t j=0; j<l; j++)
+                {   CHECK_EQUAL(dna::hash(sequences(i,j)), set(i,j)) ;
+                    CHECK_EQUAL(dna::hash(sequences(i,j)), set.get(i,j)) ;
+                    CHECK_EQUAL(toupper(sequences(i,j)), set.get_char(i,j)) ;
+                }
+            }
+            CHECK_THROW(set.get(3, 0), std::out_of_range) ;
+            CHECK_THROW(set.get(0, l), std::out_of_range) ;
+        }
+    }
+
+    // tests that invalid characters are refused
+    TEST(constructor_invalid)
+    {   for(const auto& c : dna::get_invalid_dna_char())
+        {   Matrix2D<char> sequences(2, 40, 'A') ;
+            sequences(1,35) = c ;
+            CHECK_THROW(PackedSequenceSet set(sequences), std::invalid_argument) ;
+        }
+    }
+
+    // tests unpack()
+    TEST(unpack)
+    {   Matrix2D<char> sequences(2,4) ;
+        sequences(0,0) = 'A' ; sequences(0,1) = 'c' ; sequences(0,2) = 'G' ; sequences(0,3) = 't' ;
+        sequences(1,0) = 'T' ; sequences(1,1) = 'A' ; sequences(1,2) = 'C' ; sequences(1,3) = 'G' ;
+        Matrix2D<char> unpacked = PackedSequenceSet(sequences).unpack() ;
+        for(size_t i=0; i<2; i++)
+        {   for(size_t j=0; j<4; j++)
+            {   CHECK_EQUAL(toupper(sequences(i,j)), unpacked(i,j)) ; }
+        }
+    }
+
+    // tests the subset constructor
+    TEST(constructor_subset)
+    {   // spans several words
+        Matrix2D<char> sequences(4,40) ;
+        for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<40; j++)
+            {   sequences(i,j) = "ACGT"[(i*5+j) % 4] ; }
+        }
+        PackedSequenceSet set(sequences) ;
+        std::vector<size_t> indices = {3, 0, 3} ;
+        PackedSequenceSet subset(set, indices) ;
+        CHECK_EQUAL(3, subset.get_nseq()) ;
+        CHECK_EQUAL(40, subset.get_lseq()) ;
+        for(size_t i=0; i<indices.size(); i++)
+        {   for(size_t j=0; j<40; j++)
+            {   CHECK_EQUAL(set(indices[i],j), subset(i,j)) ; }
+        }
+        CHECK_THROW(PackedSequenceSet(set, {0, 4}), std::out_of_range) ;
+    }
+
+    TEST(decode)
+    {   // spans several words
+        Matrix2D<char> sequences(2,70) ;
+        for(size_t i=0; i<2; i++)
+        {   for(size_t j=0; j<70; j++)
+            {   sequences(i,j) = "ACGT"[(i+j*j) % 4] ; }
+        }
+        PackedSequenceSet set(sequences) ;
+        std::vector<int32_t> codes ;
+        for(size_t i=0; i<2; i++)
+        {   set.decode(i, codes) ;
+            CHECK_EQUAL(70, codes.size()) ;
+            for(size_t j=0; j<70; j++)
+            {   CHECK_EQUAL(dna::hash(sequences(i,j)), static_cast<size_t>(codes[j])) ; }
+        }
+    }
+
+    // tests the packed versions of dna::score_sequence() and
+    // dna::base_composition() against the character matrix ones
+    TEST(dna_utility)
+    {   Matrix2D<char> sequences(2,4) ;
+        sequences(0,0) = 'A' ; sequences(0,1) = 'C' ; sequences(0,2) = 'G' ; sequences(0,3) = 'T' ;
+        sequences(1,0) = 'A' ; sequences(1,1) = 'A' ; sequences(1,2) = 'A' ; sequences(1,3) = 'A' ;
+        PackedSequenceSet set(sequences) ;
+
+        Matrix2D<double> motif(4,3) ;
+        for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<3; j++)
+            {   motif(i,j) = -1. * (i+1) * (j+2) ; }
+        }
+        for(size_t i=0; i<2; i++)
+        {   for(size_t s=0; s<2; s++)
+            {   CHECK_EQUAL(dna::score_sequence(sequences, i, s, motif),
+                            dna::score_sequence(set, i, s, motif)) ;
+            }
+        }
+
+        std::vector<double> comp     = dna::base_composition(sequences, false) ;
+        std::vector<double> comp_rev = dna::base_composition(sequences, true) ;
+        CHECK_ARRAY_EQUAL(comp,     dna::base_composition(set, false), comp.size()) ;
+        CHECK_ARRAY_EQUAL(comp_rev, dna::base_composition(set, true),  comp_rev.size()) ;
+    }
+}
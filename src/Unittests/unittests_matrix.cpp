@@ -1419,6 +1419,29 @@ SUITE(Matrix4D)
         }
     }
 
+    // tests move constructor and move assignment, the moved matrix is left empty
+    TEST(constructor_move)
+    {   int  n = 999 ;
+        for(size_t i=1; i<10; i++)
+        {   for(size_t j=1; j<10; j++)
+            {   for(size_t k=1; k<10; k++)
+                {   for(size_t l=1; l<10; l++)
+                    {   Matrix4D<int> m(i,j,k,l,n) ;
+                        Matrix4D<int> m1(m) ;
+                        Matrix4D<int> m2(std::move(m1)) ;
+                        CHECK_EQUAL(m, m2) ;
+                        CHECK_EQUAL(0, m1.get_data_size()) ;
+                        Matrix4D<int> m3(1,1,1,1,0) ;
+                        m3 = std::move(m2) ;
+                        CHECK_EQUAL(m, m3) ;
+                        CHECK_EQUAL(0, m2.get_data_size()) ;
+                        CHECK_EQUAL(n, m3(i-1,j-1,k-1,l-1)) ;
+                    }
+                }
+            }
+        }
+    }
+
     // tests contructor from file, uses the == operator
     TEST(constructor_file)
     {
@@ -1571,6 +1594,34 @@ SUITE(Matrix4D)
         }
     }
 
+    // tests the parenthesis operator, also on copies and assigned
+    // matrices
+    TEST(parenthesis_operator)
+    {   int n = 999 ;
+        for(size_t i=0; i<6; i++)
+        {   for(size_t j=0; j<6; j++)
+            {   for(size_t k=0; k<6; k++)
+                {   for(size_t l=0; l<6; l++)
+                    {   Matrix4D<int> m(i,j,k,l,n) ;
+                        for(size_t a=0; a<m.get_data_size(); a++)
+                        {   std::vector<size_t> coord = convert_to_coord(m, a) ;
+                            m(coord[0], coord[1], coord[2], coord[3]) = a ;
+                        }
+                        Matrix4D<int> m2(m) ;
+                        Matrix4D<int> m3 ;
+                        m3 = m ;
+                        for(size_t a=0; a<m.get_data_size(); a++)
+                        {   std::vector<size_t> coord = convert_to_coord(m, a) ;
+                            CHECK_EQUAL(a, m.get(a)) ;
+                            CHECK_EQUAL(a, m2(coord[0], coord[1], coord[2], coord[3])) ;
+                            CHECK_EQUAL(a, m3(coord[0], coord[1], coord[2], coord[3])) ;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
     // tests file format, writting a matrix and reading it should return the
     // same matrix, uses set() and the == operator
     TEST(file_format)
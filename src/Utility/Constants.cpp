@@ -3,3 +3,10 @@
 
 const double Constants::delta_max     = 1e-6 ;
 const double Constants::pseudo_counts = 1e-10 ;
+const size_t Constants::chunk_size    = 1 << 18 ; // 256kB, a typical L2 cache size
+const size_t Constants::sparse_period = 10 ;
+const size_t Constants::incremental_period = 10 ;
+const double Constants::split_noise   = 0.1 ;
+const size_t Constants::kmer_length   = 8 ;
+const double Constants::kmer_weight   = 0.5 ;
+const double Constants::library_bg_weight = 0.01 ;
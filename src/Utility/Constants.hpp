@@ -2,6 +2,7 @@
 #ifndef CONSTANTS_HPP
 #define CONSTANTS_HPP
 
+#include <cstddef> // size_t
 
 /*!
  * \brief The Constants class contains miscellaneous constants
@@ -16,10 +17,18 @@ class Constants
     // numerical constants
     static const double delta_max ;     // an delta value for double comparisons
     static const double pseudo_counts ; // a pseudo count value
+    static const size_t chunk_size ;    // the size of the data chunks processed by threads, in bytes
+    static const size_t sparse_period ; // the number of E-steps between two full rescorings in sparse mode
+    static const size_t incremental_period ; // the maximal number of E-steps between two full sweeps in incremental mode
+    static const double split_noise ;   // the largest relative perturbation of the copies of a split motif
+    static const size_t kmer_length ;   // the largest k-mer length used by the k-mer seeding
+    static const double kmer_weight ;   // the weight of a k-mer relative to the background in a k-mer seeded motif
+    static const double library_bg_weight ; // the weight of the background mixed into the motifs of a library
 
     // collections of values
     enum flip {FORWARD=0, REVERSE, N_FLIP_STATES=2} ;
     enum clustering_codes {CONVERGENCE=0, SUCCESS, FAILURE, N_CODES=3} ;
+    enum stopping_rules {POST_PROB_DELTA=0, LOG_LIKELIHOOD, BOTH, N_RULES=3} ;
 } ;
 
 #endif // CONSTANTS_HPP
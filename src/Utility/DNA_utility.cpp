@@ -5,8 +5,22 @@
 #include <stdexcept>  // invalid_argument
 #include <limits>     // numeric_limits
 #include <vector>
+#include <string>
+#include <algorithm>  // fill, find
+#include <cstdint>    // int32_t
+#include <cmath>      // log()
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// the SIMD kernels are compiled for their own target and are only
+// called if the CPU supports them
+#define DNA_UTILITY_X86_KERNELS
+#include <immintrin.h>
+#endif
 
 #include "Matrix/Matrix2D.hpp"
+#include "Matrix/Matrix3D.hpp"
+#include "Utility/PackedSequenceSet.hpp"
+#include "Utility/Constants.hpp"
 
 
 std::string dna::get_valid_dna_char()
@@ -117,6 +131,315 @@ double dna::score_sequence(const Matrix2D<char>& sequences, size_t seq_index, si
 }
 
 
+double dna::score_sequence(const PackedSequenceSet& sequences, size_t seq_index, size_t from, const Matrix2D<double>& motif_log)
+{
+    assert(sequences.get_lseq() >= motif_log.get_ncol()) ;
+    assert(sequences.get_nseq() > seq_index) ;
+    assert(motif_log.get_nrow() == 4) ;
+
+    size_t to = from + motif_log.get_ncol() ; // will score [from, to)
+
+    assert(to <= sequences.get_lseq()) ;
+
+    double log_likelihood = 0 ;
+    for(size_t i=from, j=0; i<to; i++, j++)
+    {   log_likelihood += motif_log(sequences(seq_index,i), j) ; }
+    return log_likelihood ;
+}
+
+
+std::vector<double> dna::interleave_motifs(const std::vector<Matrix2D<double>>& motifs_log,
+                                           bool both_strands)
+{   assert(motifs_log.size() > 0) ;
+
+    size_t l_motif  = motifs_log[0].get_ncol() ;
+    size_t n_strand = both_strands ? 2 : 1 ;
+    size_t n_motif  = n_strand*motifs_log.size() ;
+    std::vector<double> motifs(4*l_motif*n_motif) ;
+    for(size_t k=0; k<motifs_log.size(); k++)
+    {   assert(motifs_log[k].get_nrow() == 4) ;
+        assert(motifs_log[k].get_ncol() == l_motif) ;
+        for(size_t j=0; j<l_motif; j++)
+        {   for(size_t b=0; b<4; b++)
+            {   double* values = motifs.data() + (4*j+b)*n_motif + k*n_strand ;
+                // forward strand
+                values[0] = motifs_log[k](b,j) ;
+                // reverse complement strand
+                if(both_strands)
+                {   values[1] = motifs_log[k](3-b,l_motif-j-1) ; }
+            }
+        }
+    }
+    return motifs ;
+}
+
+
+/*!
+ * \brief Portable implementation of score_all_shifts_all_motifs(), scores
+ * the shifts [from, n_shift).
+ */
+static void score_all_shifts_all_motifs_generic(const int32_t* sequence, const double* motifs,
+                                                size_t l_motif, size_t n_motif, size_t from,
+                                                size_t n_shift, double* scores)
+{   for(size_t s=from; s<n_shift; s++)
+    {   double* score = scores + s*n_motif ;
+        std::fill(score, score + n_motif, 0.) ;
+        for(size_t j=0; j<l_motif; j++)
+        {   const double* values = motifs + (4*j + sequence[s+j])*n_motif ;
+            for(size_t m=0; m<n_motif; m++)
+            {   score[m] += values[m] ; }
+        }
+    }
+}
+
+#ifdef DNA_UTILITY_X86_KERNELS
+/*!
+ * \brief AVX2 implementation of score_all_shifts_all_motifs() for a few
+ * motifs, scores 4 shifts of a motif at a time, the values of the motif
+ * being gathered from the interleaved table. Each lane accumulates the
+ * motif positions in the same order as the portable implementation does,
+ * such that the scores are identical.
+ */
+__attribute__((target("avx2")))
+static void score_all_shifts_by_shift_avx2(const int32_t* sequence, const double* motifs,
+                                           size_t l_motif, size_t n_motif, size_t n_shift,
+                                           double* scores)
+{   size_t s = 0 ;
+    // gathers with an explicit source and mask, the source of the
+    // unmasked gather being undefined
+    const __m256d zero   = _mm256_setzero_pd() ;
+    const __m256d all    = _mm256_castsi256_pd(_mm256_set1_epi64x(-1)) ;
+    const __m128i stride = _mm_set1_epi32(static_cast<int>(n_motif)) ;
+    double block[4] ;
+    for( ; s+4<=n_shift; s+=4)
+    {   for(size_t m=0; m<n_motif; m++)
+        {   __m256d log_likelihood = _mm256_setzero_pd() ;
+            for(size_t j=0; j<l_motif; j++)
+            {   // the rows of the bases of the 4 windows at position j
+                __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sequence + s + j)) ;
+                index         = _mm_mullo_epi32(_mm_add_epi32(index, _mm_set1_epi32(static_cast<int>(4*j))), stride) ;
+                log_likelihood = _mm256_add_pd(log_likelihood, _mm256_mask_i32gather_pd(zero, motifs + m, index, all, 8)) ;
+            }
+            _mm256_storeu_pd(block, log_likelihood) ;
+            for(size_t i=0; i<4; i++)
+            {   scores[(s+i)*n_motif + m] = block[i] ; }
+        }
+    }
+    // the remaining shifts are scored by non vectorized code, avoid
+    // AVX to SSE transition penalties
+    _mm256_zeroupper() ;
+    score_all_shifts_all_motifs_generic(sequence, motifs, l_motif, n_motif, s, n_shift, scores) ;
+}
+
+/*!
+ * \brief AVX-512 implementation of score_all_shifts_all_motifs() for a few
+ * motifs, scores 8 shifts of a motif at a time, the values of the motif
+ * being gathered from the interleaved table. Each lane accumulates the
+ * motif positions in the same order as the portable implementation does,
+ * such that the scores are identical.
+ */
+__attribute__((target("avx512f")))
+static void score_all_shifts_by_shift_avx512(const int32_t* sequence, const double* motifs,
+                                             size_t l_motif, size_t n_motif, size_t n_shift,
+                                             double* scores)
+{   size_t s = 0 ;
+    const __m512d zero   = _mm512_setzero_pd() ;
+    const __m256i stride = _mm256_set1_epi32(static_cast<int>(n_motif)) ;
+    // the offsets of the scores of the 8 shifts in the score table
+    const __m256i offset = _mm256_mullo_epi32(_mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0), stride) ;
+    for( ; s+8<=n_shift; s+=8)
+    {   for(size_t m=0; m<n_motif; m++)
+        {   __m512d log_likelihood = _mm512_setzero_pd() ;
+            for(size_t j=0; j<l_motif; j++)
+            {   // the rows of the bases of the 8 windows at position j
+                __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sequence + s + j)) ;
+                index         = _mm256_mullo_epi32(_mm256_add_epi32(index, _mm256_set1_epi32(static_cast<int>(4*j))), stride) ;
+                log_likelihood = _mm512_add_pd(log_likelihood, _mm512_mask_i32gather_pd(zero, 0xFF, index, motifs + m, 8)) ;
+            }
+            _mm512_i32scatter_pd(scores + s*n_motif + m, offset, log_likelihood, 8) ;
+        }
+    }
+    _mm256_zeroupper() ;
+    score_all_shifts_all_motifs_generic(sequence, motifs, l_motif, n_motif, s, n_shift, scores) ;
+}
+
+/*!
+ * \brief AVX2 implementation of score_all_shifts_all_motifs(), scores 4
+ * motifs at a time, for each shift. The lanes beyond the last motif are
+ * masked.
+ */
+__attribute__((target("avx2")))
+static void score_all_shifts_all_motifs_avx2(const int32_t* sequence, const double* motifs,
+                                             size_t l_motif, size_t n_motif, size_t n_shift,
+                                             double* scores)
+{   for(size_t s=0; s<n_shift; s++)
+    {   double* score = scores + s*n_motif ;
+        for(size_t m=0; m<n_motif; m+=4)
+        {   __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(static_cast<long long>(n_motif-m)),
+                                              _mm256_set_epi64x(3, 2, 1, 0)) ;
+            __m256d log_likelihood = _mm256_setzero_pd() ;
+            for(size_t j=0; j<l_motif; j++)
+            {   const double* values = motifs + (4*j + sequence[s+j])*n_motif + m ;
+                log_likelihood = _mm256_add_pd(log_likelihood, _mm256_maskload_pd(values, mask)) ;
+            }
+            _mm256_maskstore_pd(score + m, mask, log_likelihood) ;
+        }
+    }
+}
+
+/*!
+ * \brief AVX-512 implementation of score_all_shifts_all_motifs(), scores 8
+ * motifs at a time, for each shift. The lanes beyond the last motif are
+ * masked.
+ */
+__attribute__((target("avx512f")))
+static void score_all_shifts_all_motifs_avx512(const int32_t* sequence, const double* motifs,
+                                               size_t l_motif, size_t n_motif, size_t n_shift,
+                                               double* scores)
+{   for(size_t s=0; s<n_shift; s++)
+    {   double* score = scores + s*n_motif ;
+        for(size_t m=0; m<n_motif; m+=8)
+        {   __mmask8 mask = n_motif-m >= 8 ? 0xFF : static_cast<__mmask8>((1u << (n_motif-m)) - 1) ;
+            __m512d log_likelihood = _mm512_setzero_pd() ;
+            for(size_t j=0; j<l_motif; j++)
+            {   const double* values = motifs + (4*j + sequence[s+j])*n_motif + m ;
+                log_likelihood = _mm512_add_pd(log_likelihood, _mm512_maskz_loadu_pd(mask, values)) ;
+            }
+            _mm512_mask_storeu_pd(score + m, mask, log_likelihood) ;
+        }
+    }
+}
+#endif // DNA_UTILITY_X86_KERNELS
+
+/*!
+ * \brief The different implementations of score_all_shifts_all_motifs().
+ */
+enum class score_kernel {GENERIC, AVX2, AVX512} ;
+
+/*!
+ * \brief Detects the best implementation of score_all_shifts_all_motifs()
+ * supported by the CPU.
+ * \return the implementation to use.
+ */
+static score_kernel detect_score_kernel()
+{
+#ifdef DNA_UTILITY_X86_KERNELS
+    __builtin_cpu_init() ;
+    if(__builtin_cpu_supports("avx512f"))
+    {   return score_kernel::AVX512 ; }
+    else if(__builtin_cpu_supports("avx2"))
+    {   return score_kernel::AVX2 ; }
+#endif
+    return score_kernel::GENERIC ;
+}
+
+/*!
+ * \brief Gives access to the implementation of score_all_shifts_all_motifs()
+ * in use, detected once and which can be forced using
+ * dna::set_score_all_shifts_kernel().
+ * \return a reference to the implementation to use.
+ */
+static score_kernel& get_score_kernel()
+{   static score_kernel kernel = detect_score_kernel() ;
+    return kernel ;
+}
+
+/*!
+ * \brief Returns the name of an implementation of
+ * score_all_shifts_all_motifs().
+ * \param kernel the implementation of interest.
+ * \return the name of the implementation.
+ */
+static std::string get_score_kernel_name(score_kernel kernel)
+{   switch(kernel)
+    {   case score_kernel::AVX512:
+            return "avx512" ;
+        case score_kernel::AVX2:
+            return "avx2" ;
+        default:
+            return "generic" ;
+    }
+}
+
+
+void dna::score_all_shifts_all_motifs(const std::vector<int32_t>& sequence,
+                                      const std::vector<double>& motifs_log,
+                                      size_t n_motif,
+                                      std::vector<double>& scores)
+{   assert(n_motif > 0) ;
+
+    size_t l_motif = motifs_log.size() / (4*n_motif) ;
+
+    assert(motifs_log.size() == 4*l_motif*n_motif) ;
+    assert(sequence.size() >= l_motif) ;
+
+    size_t n_shift = sequence.size() - l_motif + 1 ;
+    scores.resize(n_shift*n_motif) ;
+
+    // with one or two motifs, most of the lanes of the kernels vectorized
+    // over the motifs would be masked, the shifts are vectorized instead
+    switch(get_score_kernel())
+    {
+#ifdef DNA_UTILITY_X86_KERNELS
+        case score_kernel::AVX512:
+            if(n_motif <= 2)
+            {   score_all_shifts_by_shift_avx512(sequence.data(), motifs_log.data(), l_motif, n_motif, n_shift,
+                                                 scores.data()) ;
+            }
+            else
+            {   score_all_shifts_all_motifs_avx512(sequence.data(), motifs_log.data(), l_motif, n_motif, n_shift,
+                                                   scores.data()) ;
+            }
+            break ;
+        case score_kernel::AVX2:
+            if(n_motif <= 2)
+            {   score_all_shifts_by_shift_avx2(sequence.data(), motifs_log.data(), l_motif, n_motif, n_shift,
+                                               scores.data()) ;
+            }
+            else
+            {   score_all_shifts_all_motifs_avx2(sequence.data(), motifs_log.data(), l_motif, n_motif, n_shift,
+                                                 scores.data()) ;
+            }
+            break ;
+#endif
+        default:
+            score_all_shifts_all_motifs_generic(sequence.data(), motifs_log.data(), l_motif, n_motif, 0, n_shift,
+                                                scores.data()) ;
+            break ;
+    }
+}
+
+std::string dna::score_all_shifts_kernel()
+{   return get_score_kernel_name(get_score_kernel()) ; }
+
+
+std::vector<std::string> dna::score_all_shifts_kernels()
+{   std::vector<std::string> kernels(1, get_score_kernel_name(score_kernel::GENERIC)) ;
+    score_kernel best = detect_score_kernel() ;
+    if(best == score_kernel::AVX2 || best == score_kernel::AVX512)
+    {   kernels.push_back(get_score_kernel_name(score_kernel::AVX2)) ; }
+    if(best == score_kernel::AVX512)
+    {   kernels.push_back(get_score_kernel_name(score_kernel::AVX512)) ; }
+    return kernels ;
+}
+
+
+void dna::set_score_all_shifts_kernel(const std::string& kernel) throw (std::invalid_argument)
+{   for(score_kernel k : {score_kernel::GENERIC, score_kernel::AVX2, score_kernel::AVX512})
+    {   if(kernel == get_score_kernel_name(k))
+        {   std::vector<std::string> kernels = dna::score_all_shifts_kernels() ;
+            if(std::find(kernels.begin(), kernels.end(), kernel) == kernels.end())
+            {   throw std::invalid_argument("error! the " + kernel + " kernel is not supported "
+                                            "by this machine!") ;
+            }
+            get_score_kernel() = k ;
+            return ;
+        }
+    }
+    throw std::invalid_argument("error! unknown kernel " + kernel + "!") ;
+}
+
+
 std::vector<double> dna::base_composition(const Matrix2D<char> &sequences, bool both_strands) throw (std::invalid_argument)
 {
     double total = 0. ;
@@ -149,3 +472,144 @@ std::vector<double> dna::base_composition(const Matrix2D<char> &sequences, bool
 
     return base_comp ;
 }
+
+
+std::vector<double> dna::base_composition(const PackedSequenceSet& sequences, bool both_strands)
+{
+    // count the bases
+    std::vector<double> counts(4,0.) ;
+    for(size_t i=0; i<sequences.get_nseq(); i++)
+    {   for(size_t j=0; j<sequences.get_lseq(); j++)
+        {   counts[sequences(i,j)] += 1. ; }
+    }
+
+    double total = 0. ;
+    std::vector<double> base_comp(4,0.) ;
+    for(size_t i=0; i<4; i++)
+    {   // forward strand
+        base_comp[i] += counts[i] ;
+        total        += counts[i] ;
+        // reverse complement strand
+        if(both_strands)
+        {   base_comp[4-i-1] += counts[i] ;
+            total            += counts[i] ;
+        }
+    }
+
+    // normalize
+    for(auto& i : base_comp)
+    {   i /= total ; }
+
+    return base_comp ;
+}
+
+Matrix3D<double> dna::background_log_prefix(const PackedSequenceSet& sequences,
+                                            const std::vector<double>& bg_prob,
+                                            bool both_strands) throw (std::invalid_argument)
+{   if(bg_prob.size() != 4)
+    {   throw std::invalid_argument("error! 4 background probabilities are expected!") ; }
+    std::vector<double> bg_log(4) ;
+    for(size_t b=0; b<4; b++)
+    {   bg_log[b] = log(bg_prob[b]) ; }
+
+    size_t n_flip = 1 + both_strands ;
+    Matrix3D<double> prefix(sequences.get_nseq(), sequences.get_lseq()+1, n_flip, 0.) ;
+    for(size_t i=0; i<sequences.get_nseq(); i++)
+    {   for(size_t j=0; j<sequences.get_lseq(); j++)
+        {   size_t base = sequences(i,j) ;
+            prefix(i,j+1,0) = prefix(i,j,0) + bg_log[base] ;
+            if(both_strands)
+            {   prefix(i,j+1,1) = prefix(i,j,1) + bg_log[3-base] ; }
+        }
+    }
+    return prefix ;
+}
+
+void dna::count_kmers(const PackedSequenceSet& sequences,
+                      size_t k,
+                      bool both_strands,
+                      size_t from,
+                      size_t to,
+                      std::vector<uint64_t>& counts) throw (std::invalid_argument)
+{   if(k == 0 or k > 31)
+    {   throw std::invalid_argument("error! the k-mer length should be in [1,31]!") ; }
+    else if(counts.size() != (static_cast<size_t>(1) << (2*k)))
+    {   throw std::invalid_argument("error! the k-mer count table should have 4^k values!") ; }
+
+    uint64_t mask  = (static_cast<uint64_t>(1) << (2*k)) - 1 ;
+    size_t   shift = 2*(k-1) ;
+    for(size_t i=from; i<to; i++)
+    {   // the rolling codes of the current k-mer and of its reverse complement
+        uint64_t code     = 0 ;
+        uint64_t code_rev = 0 ;
+        for(size_t j=0; j<sequences.get_lseq(); j++)
+        {   uint64_t base = sequences(i,j) ;
+            code     = ((code << 2) | base) & mask ;
+            code_rev = (code_rev >> 2) | ((3-base) << shift) ;
+            if(j+1 >= k)
+            {   counts[code]++ ;
+                if(both_strands)
+                {   counts[code_rev]++ ; }
+            }
+        }
+    }
+}
+
+uint64_t dna::kmer_reverse_complement(uint64_t code, size_t k)
+{   uint64_t code_rev = 0 ;
+    for(size_t j=0; j<k; j++, code >>= 2)
+    {   code_rev = (code_rev << 2) | (3 - (code & 3)) ; }
+    return code_rev ;
+}
+
+std::vector<double> dna::best_site_log_odds(const PackedSequenceSet& sequences,
+                                            const std::vector<Matrix2D<double>>& motifs,
+                                            const std::vector<double>& bg_prob,
+                                            bool both_strands) throw (std::invalid_argument)
+{   if(bg_prob.size() != 4)
+    {   throw std::invalid_argument("error! the background should contain 4 probabilities!") ; }
+    else if(motifs.size() == 0)
+    {   return std::vector<double>() ; }
+
+    // the log-odds motifs
+    size_t l_motif = motifs[0].get_ncol() ;
+    std::vector<Matrix2D<double>> motifs_log_odds(motifs.size(), Matrix2D<double>(4, l_motif)) ;
+    for(size_t k=0; k<motifs.size(); k++)
+    {   if(motifs[k].get_nrow() != 4)
+        {   throw std::invalid_argument("error! the motifs should have 4 rows!") ; }
+        else if(motifs[k].get_ncol() != l_motif or l_motif == 0 or l_motif > sequences.get_lseq())
+        {   throw std::invalid_argument("error! the motifs should all have the same length, "
+                                        "at most the sequence length!") ;
+        }
+        for(size_t i=0; i<4; i++)
+        {   for(size_t j=0; j<l_motif; j++)
+            {   motifs_log_odds[k](i,j) = std::log(std::max(motifs[k](i,j), Constants::pseudo_counts)) -
+                                          std::log(std::max(bg_prob[i], Constants::pseudo_counts)) ;
+            }
+        }
+    }
+    size_t n_strand = both_strands ? 2 : 1 ;
+    size_t n_motif  = n_strand*motifs.size() ;
+    size_t n_shift  = sequences.get_lseq() - l_motif + 1 ;
+    std::vector<double> motifs_interleaved = dna::interleave_motifs(motifs_log_odds, both_strands) ;
+
+    // the best site of each sequence, over the shifts and strands
+    std::vector<double> best_sites(motifs.size(), 0.) ;
+    std::vector<int32_t> sequence ;
+    std::vector<double> scores ;
+    std::vector<double> best_site(motifs.size()) ;
+    for(size_t i=0; i<sequences.get_nseq(); i++)
+    {   sequences.decode(i, sequence) ;
+        dna::score_all_shifts_all_motifs(sequence, motifs_interleaved, n_motif, scores) ;
+        std::fill(best_site.begin(), best_site.end(), -std::numeric_limits<double>::max()) ;
+        for(size_t s=0; s<n_shift; s++)
+        {   for(size_t m=0; m<n_motif; m++)
+            {   best_site[m/n_strand] = std::max(best_site[m/n_strand], scores[s*n_motif+m]) ; }
+        }
+        for(size_t k=0; k<motifs.size(); k++)
+        {   best_sites[k] += best_site[k] ; }
+    }
+    for(auto& best : best_sites)
+    {   best /= static_cast<double>(std::max(sequences.get_nseq(), static_cast<size_t>(1))) ; }
+    return best_sites ;
+}
@@ -2,8 +2,13 @@
 #define DNA_UTILITY_HPP
 
 #include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>    // int32_t, uint64_t
 #include <stdexcept>  // invalid_argument
 #include "Matrix/Matrix2D.hpp"
+#include "Matrix/Matrix3D.hpp"
+#include "Utility/PackedSequenceSet.hpp"
 
 namespace dna
 {
@@ -64,6 +69,98 @@ namespace dna
      */
     double score_sequence(const Matrix2D<char>& sequences, size_t seq_index, size_t from, const Matrix2D<double>& motif_log) ;
 
+    /*!
+     * \brief Scores a specific part of a sequence contained in the given encoded
+     * sequence set using the given motif. The motif is expected to containing log
+     * probability. Only the sub-sequence [from->from+motif_length) from the
+     * seq_index-th sequence of the set will be scored.
+     * \param sequences a reference to the set containing the sub-sequence to
+     * score.
+     * \param seq_index the index of the sequence to score in the set.
+     * \param from the first position of the subsequence to score using the motif
+     * \param motif_log a matrix containing log probabilities. The matrix should be
+     * a motif in horizontal format, that is with 4 rows corresponding to A (0th),
+     * C (1st), G (2nd) and T (4th).
+     * \return the log likelihood of the sequence given the model.
+     */
+    double score_sequence(const PackedSequenceSet& sequences, size_t seq_index, size_t from, const Matrix2D<double>& motif_log) ;
+
+    /*!
+     * \brief Converts a set of log motifs of equal length, in horizontal
+     * format (4 rows corresponding to A, C, G and T), into the interleaved
+     * format used by score_all_shifts_all_motifs() : for each position j
+     * and base b, the values of all the motifs are contiguous. If the
+     * reverse complement of the motifs is also used, the mth motif has
+     * index 2*m and its reverse complement 2*m+1 within a block, otherwise
+     * the mth motif has index m. With n the number of motifs per block,
+     * the value of the motif of index m for base b at position j is
+     * stored at index (4*j+b)*n + m.
+     * \param motifs_log the matrices containing log probabilities, in
+     * horizontal format.
+     * \param both_strands whether the reverse complement of each motif
+     * should be interleaved right after the motif.
+     * \return the interleaved log motifs.
+     */
+    std::vector<double> interleave_motifs(const std::vector<Matrix2D<double>>& motifs_log,
+                                          bool both_strands) ;
+
+    /*!
+     * \brief Scores all the sub-sequences of an encoded sequence, at each
+     * possible shift, using several motifs in a single pass over the
+     * sequence. For each shift, the rows of the motifs corresponding to
+     * the bases of the window are read contiguously and summed
+     * element-wise, such that all the scores of a shift are computed
+     * together. The scores are identical to the ones score_sequence()
+     * would return for each motif.
+     * The scores are computed using the widest SIMD instruction set
+     * available on the machine, detected at runtime (AVX-512 or AVX2), or
+     * a portable implementation otherwise (see score_all_shifts_kernel()).
+     * With one or two motifs, the SIMD implementations score several
+     * shifts at a time rather than several motifs.
+     * \param sequence the codes of the bases of the sequence, as returned by
+     * PackedSequenceSet::decode(). Should be at least as long as the motifs.
+     * \param motifs_log the log motifs in interleaved format, see
+     * interleave_motifs().
+     * \param n_motif the number of motifs in motifs_log (twice the number
+     * of matrices if the reverse complements were interleaved).
+     * \param scores a vector in which the scores are written, resized to
+     * the number of shifts times the number of motifs if needed. The score
+     * of the motif of index m at shift s is stored at index s*n_motif + m.
+     */
+    void score_all_shifts_all_motifs(const std::vector<int32_t>& sequence,
+                                     const std::vector<double>& motifs_log,
+                                     size_t n_motif,
+                                     std::vector<double>& scores) ;
+
+    /*!
+     * \brief Returns the name of the implementation used by
+     * score_all_shifts_all_motifs() : "avx512", "avx2" or "generic".
+     * Unless set_score_all_shifts_kernel() was called, this is the widest
+     * implementation supported by the machine.
+     * \return the name of the implementation.
+     */
+    std::string score_all_shifts_kernel() ;
+
+    /*!
+     * \brief Returns the names of the implementations of
+     * score_all_shifts_all_motifs() supported by the machine, the portable
+     * one first.
+     * \return the names of the supported implementations.
+     */
+    std::vector<std::string> score_all_shifts_kernels() ;
+
+    /*!
+     * \brief Forces the implementation used by
+     * score_all_shifts_all_motifs(), for instance to test the portable
+     * implementation on a machine supporting a SIMD one. This should not be called while
+     * sequences are being scored.
+     * \param kernel the name of the implementation, one of the values
+     * returned by score_all_shifts_kernels().
+     * \throw std::invalid_argument if the implementation is not supported
+     * by the machine.
+     */
+    void set_score_all_shifts_kernel(const std::string& kernel) throw (std::invalid_argument) ;
+
     /*!
      * \brief Computes the base composition of a set of sequences contained in a matrix.
      * \param sequences a matrix containing the sequences of interest.
@@ -74,6 +171,91 @@ namespace dna
      */
     std::vector<double> base_composition(const Matrix2D<char>& sequences, bool both_strands=false) throw (std::invalid_argument) ;
 
+    /*!
+     * \brief Computes the base composition of a set of encoded sequences.
+     * \param sequences the set of sequences of interest.
+     * \param both_strands also accounts for the reverse complement of the sequences.
+     * \return a vector of 4 values corresponding to the frequencies of A,C,G and T
+     * respectively.
+     */
+    std::vector<double> base_composition(const PackedSequenceSet& sequences, bool both_strands=false) ;
+
+    /*!
+     * \brief Computes, for each sequence, the prefix sums of the log background
+     * probabilities of its bases, such that the background log likelihood of the
+     * bases [from,to) of a sequence is the difference of the values at to and from.
+     * Unlike the likelihoods of the sub-sequences, these values do not depend on a
+     * motif length.
+     * \param sequences the set of sequences of interest.
+     * \param bg_prob the background probabilities of A,C,G and T.
+     * \param both_strands also computes the prefix sums of the complement bases.
+     * \throw std::invalid_argument if bg_prob does not contain 4 values.
+     * \return a N x (L+1) x F matrix, N being the number of sequences, L their
+     * length and F 2 if both strands are computed (the complement bases being in
+     * the second slice) or 1 otherwise.
+     */
+    Matrix3D<double> background_log_prefix(const PackedSequenceSet& sequences,
+                                           const std::vector<double>& bg_prob,
+                                           bool both_strands=false) throw (std::invalid_argument) ;
+
+    /*!
+     * \brief Counts the occurences of all the k-mers in a range of encoded
+     * sequences, in a single pass over each sequence. The k-mers are
+     * represented by 2 bits codes, the first base being the most
+     * significant, such that the code of a k-mer is updated by a shift
+     * and a bitwise or at each position.
+     * \param sequences the set of sequences of interest.
+     * \param k the k-mer length, at least 1 and at most 31.
+     * \param both_strands also counts the k-mers of the reverse
+     * complement of the sequences.
+     * \param from the index of the first sequence to process.
+     * \param to the index of the past last sequence to process.
+     * \param counts a table of 4^k values, indexed by the k-mer codes,
+     * to which the counts are added.
+     * \throw std::invalid_argument if k is out of range or if the table
+     * does not have 4^k values.
+     */
+    void count_kmers(const PackedSequenceSet& sequences,
+                     size_t k,
+                     bool both_strands,
+                     size_t from,
+                     size_t to,
+                     std::vector<uint64_t>& counts) throw (std::invalid_argument) ;
+
+    /*!
+     * \brief Computes the code of the reverse complement of a k-mer, the
+     * codes being those used by count_kmers().
+     * \param code the k-mer code.
+     * \param k the k-mer length.
+     * \return the code of the reverse complement k-mer.
+     */
+    uint64_t kmer_reverse_complement(uint64_t code, size_t k) ;
+
+    /*!
+     * \brief Computes, for each motif, the average over a set of encoded
+     * sequences of the log-odds score of the best site of each sequence,
+     * that is the largest sum, over the motif positions, of the log ratio
+     * between the motif and the background probabilities of the bases.
+     * All the motifs are scored together, in a single pass over each
+     * sequence, using score_all_shifts_all_motifs(). The probabilities
+     * are floored to Constants::pseudo_counts.
+     * \param sequences the set of sequences of interest.
+     * \param motifs the motifs, containing probabilities, in horizontal
+     * format. They should all have the same length, at most the sequence
+     * length.
+     * \param bg_prob the background probabilities of A, C, G and T.
+     * \param both_strands also considers the sites on the reverse
+     * complement of the sequences.
+     * \throw std::invalid_argument if the motifs do not have 4 rows, do
+     * not have the same length, are longer than the sequences or if the
+     * background does not have 4 probabilities.
+     * \return the average best site score of each motif.
+     */
+    std::vector<double> best_site_log_odds(const PackedSequenceSet& sequences,
+                                           const std::vector<Matrix2D<double>>& motifs,
+                                           const std::vector<double>& bg_prob,
+                                           bool both_strands=false) throw (std::invalid_argument) ;
+
 }
 
 #endif // DNA_UTILITY_HPP
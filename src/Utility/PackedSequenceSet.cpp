@@ -0,0 +1,74 @@
+#include "PackedSequenceSet.hpp"
+
+#include <vector>
+#include <algorithm>  // copy()
+#include <stdexcept>  // invalid_argument, out_of_range
+
+#include "Matrix/Matrix2D.hpp"
+#include "Utility/DNA_utility.hpp"
+
+
+PackedSequenceSet::PackedSequenceSet()
+    : _n_seq(0), _l_seq(0), _stride(0), _data()
+{}
+
+PackedSequenceSet::PackedSequenceSet(const Matrix2D<char>& sequences) throw (std::invalid_argument)
+    : _n_seq(sequences.get_nrow()), _l_seq(sequences.get_ncol()),
+      _stride((_l_seq + 31) / 32), _data(_n_seq*_stride, 0)
+{   for(size_t i=0; i<this->_n_seq; i++)
+    {   for(size_t j=0; j<this->_l_seq; j++)
+        {   // throws invalid_argument for non ACGTacgt char
+            uint64_t code = dna::hash(sequences(i,j)) ;
+            this->_data[i*this->_stride + (j >> 5)] |= code << ((j & 31) << 1) ;
+        }
+    }
+}
+
+PackedSequenceSet::PackedSequenceSet(const PackedSequenceSet& sequences,
+                                     const std::vector<size_t>& indices) throw (std::out_of_range)
+    : _n_seq(indices.size()), _l_seq(sequences._l_seq),
+      _stride(sequences._stride), _data(_n_seq*_stride, 0)
+{   for(size_t i=0; i<this->_n_seq; i++)
+    {   if(indices[i] >= sequences._n_seq)
+        {   throw std::out_of_range("sequence index is out of range!") ; }
+        std::copy(sequences._data.begin() + indices[i]*this->_stride,
+                  sequences._data.begin() + (indices[i]+1)*this->_stride,
+                  this->_data.begin() + i*this->_stride) ;
+    }
+}
+
+size_t PackedSequenceSet::get_nseq() const
+{   return this->_n_seq ; }
+
+size_t PackedSequenceSet::get_lseq() const
+{   return this->_l_seq ; }
+
+size_t PackedSequenceSet::get(size_t seq_index, size_t pos) const throw (std::out_of_range)
+{   if(seq_index >= this->_n_seq or pos >= this->_l_seq)
+    {   throw std::out_of_range("coordinates are out of range!") ; }
+    return (*this)(seq_index, pos) ;
+}
+
+char PackedSequenceSet::get_char(size_t seq_index, size_t pos) const throw (std::out_of_range)
+{   static const char bases[4] = {'A', 'C', 'G', 'T'} ;
+    return bases[this->get(seq_index, pos)] ;
+}
+
+void PackedSequenceSet::decode(size_t seq_index, std::vector<int32_t>& codes) const
+{   codes.resize(this->_l_seq) ;
+    const uint64_t* words = this->_data.data() + seq_index*this->_stride ;
+    for(size_t j=0; j<this->_l_seq; j++)
+    {   codes[j] = static_cast<int32_t>((words[j >> 5] >> ((j & 31) << 1)) & 3) ; }
+}
+
+Matrix2D<char> PackedSequenceSet::unpack() const
+{   Matrix2D<char> sequences(this->_n_seq, this->_l_seq) ;
+    for(size_t i=0; i<this->_n_seq; i++)
+    {   for(size_t j=0; j<this->_l_seq; j++)
+        {   sequences(i,j) = this->get_char(i,j) ; }
+    }
+    return sequences ;
+}
+
+size_t PackedSequenceSet::get_memory_size() const
+{   return this->_data.size() * sizeof(uint64_t) ; }
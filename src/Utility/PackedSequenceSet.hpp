@@ -0,0 +1,145 @@
+#ifndef PACKEDSEQUENCESET_HPP
+#define PACKEDSEQUENCESET_HPP
+
+#include <vector>
+#include <cstdint>    // uint64_t, int32_t
+#include <stdexcept>  // invalid_argument, out_of_range
+
+#include "Matrix/Matrix2D.hpp"
+
+
+/*!
+ * \brief The PackedSequenceSet class stores a set of DNA sequences of
+ * equal length in an encoded, compact, form. Each base is validated and
+ * hashed once, at construction, using dna::hash() and is then stored
+ * using 2 bits :
+ * 0 for 'A', 1 for 'C', 2 for 'G' and 3 for 'T'.
+ * Thus, the code of the complementary base of a base of code c is 3-c.
+ *
+ * Internally, the bases are packed in 64 bits words, 32 bases per word.
+ * Each sequence starts on a new word, such that the data of the ith
+ * sequence start at offset i*_stride in the data vector. Within a word,
+ * the jth base occupies bits [2*j, 2*j+1].
+ */
+class PackedSequenceSet
+{
+    public:
+        // constructors
+        /*!
+         * \brief Constructs an empty set (0 sequences of length 0).
+         */
+        PackedSequenceSet() ;
+        /*!
+         * \brief Constructs a set containing the sequences stored, one per
+         * row, in the given character matrix.
+         * \param sequences a character matrix with one sequence per row.
+         * \throw std::invalid_argument if a character other than
+         * ACGTacgt is found.
+         */
+        PackedSequenceSet(const Matrix2D<char>& sequences) throw (std::invalid_argument) ;
+        /*!
+         * \brief Constructs a set containing a subset of the sequences of
+         * another set. The packed words are copied, the sequences are
+         * neither decoded nor validated again.
+         * \param sequences the set of sequences to take the subset from.
+         * \param indices the indices, in sequences, of the sequences to
+         * copy, in the order in which they should be stored. An index can
+         * be given several times.
+         * \throw std::out_of_range if an index is out of range.
+         */
+        PackedSequenceSet(const PackedSequenceSet& sequences,
+                          const std::vector<size_t>& indices) throw (std::out_of_range) ;
+
+        // methods
+        /*!
+         * \brief Gets the number of sequences.
+         * \return the number of sequences.
+         */
+        size_t get_nseq() const ;
+        /*!
+         * \brief Gets the length of the sequences.
+         * \return the length of the sequences, in bp.
+         */
+        size_t get_lseq() const ;
+
+        /*!
+         * \brief Gets the code of a given base. This method does not
+         * perform any check on the coordinates.
+         * \param seq_index the index of the sequence of interest.
+         * \param pos the position of the base in the sequence.
+         * \return the code of the base (0 for A, 1 for C, 2 for G and
+         * 3 for T).
+         */
+        inline size_t operator () (size_t seq_index, size_t pos) const ;
+
+        /*!
+         * \brief Gets the code of a given base.
+         * \param seq_index the index of the sequence of interest.
+         * \param pos the position of the base in the sequence.
+         * \throw std::out_of_range if the coordinates are out of range.
+         * \return the code of the base (0 for A, 1 for C, 2 for G and
+         * 3 for T).
+         */
+        size_t get(size_t seq_index, size_t pos) const throw (std::out_of_range) ;
+
+        /*!
+         * \brief Gets a given base, as an upper case character.
+         * \param seq_index the index of the sequence of interest.
+         * \param pos the position of the base in the sequence.
+         * \throw std::out_of_range if the coordinates are out of range.
+         * \return the base.
+         */
+        char get_char(size_t seq_index, size_t pos) const throw (std::out_of_range) ;
+
+        /*!
+         * \brief Decodes the codes of the bases of a given sequence, one
+         * code per element. This method does not perform any check on
+         * the sequence index.
+         * \param seq_index the index of the sequence of interest.
+         * \param codes a vector in which the codes are written, resized
+         * to the sequence length if needed.
+         */
+        void decode(size_t seq_index, std::vector<int32_t>& codes) const ;
+
+        /*!
+         * \brief Decodes the set of sequences into a character matrix
+         * with one sequence per row. All bases are upper case.
+         * \return the character matrix.
+         */
+        Matrix2D<char> unpack() const ;
+
+        /*!
+         * \brief Gets the amount of memory used to store the bases, in
+         * bytes.
+         * \return the amount of memory used.
+         */
+        size_t get_memory_size() const ;
+
+    private:
+        // fields
+        /*!
+         * \brief the number of sequences.
+         */
+        size_t _n_seq ;
+        /*!
+         * \brief the sequence length.
+         */
+        size_t _l_seq ;
+        /*!
+         * \brief the number of words used to store each
+         * sequence.
+         */
+        size_t _stride ;
+        /*!
+         * \brief the packed bases.
+         */
+        std::vector<uint64_t> _data ;
+} ;
+
+
+inline size_t PackedSequenceSet::operator () (size_t seq_index, size_t pos) const
+{   uint64_t word = this->_data[seq_index*this->_stride + (pos >> 5)] ;
+    return (word >> ((pos & 31) << 1)) & 3 ;
+}
+
+#endif // PACKEDSEQUENCESET_HPP